@@ -0,0 +1,45 @@
+/*
+ * KeccakP-1600 state and permutation interface (SnP) of the Keccak Code Package,
+ * implemented by forwarding every call to one of several compiled backends.
+ *
+ * The backend is selected once at load time according to the features of the CPU,
+ * see KeccakP-1600-dispatch.c. The sponge construction, KeccakHash and SimpleFIPS202
+ * are compiled against this header instead of the header of a single implementation.
+ */
+
+#ifndef _KeccakP_1600_SnP_h_
+#define _KeccakP_1600_SnP_h_
+
+#include <stddef.h>
+
+#define KeccakP1600_implementation      "runtime dispatched implementation"
+// large and aligned enough for the state of every backend, the AVX2 backend needs 7*4*8 bytes
+#define KeccakP1600_stateSizeInBytes    (7 * 4 * 8)
+#define KeccakP1600_stateAlignment      64
+#define KeccakF1600_FastLoop_supported
+
+// none of the backends needs static initialization
+#define KeccakP1600_StaticInitialize()
+void KeccakP1600_Initialize(void *state);
+void KeccakP1600_AddByte(void *state, unsigned char data, unsigned int offset);
+void KeccakP1600_AddBytes(void *state, const unsigned char *data, unsigned int offset, unsigned int length);
+void KeccakP1600_OverwriteBytes(void *state, const unsigned char *data, unsigned int offset, unsigned int length);
+void KeccakP1600_OverwriteWithZeroes(void *state, unsigned int byteCount);
+void KeccakP1600_Permute_Nrounds(void *state, unsigned int nrounds);
+void KeccakP1600_Permute_12rounds(void *state);
+void KeccakP1600_Permute_24rounds(void *state);
+void KeccakP1600_ExtractBytes(const void *state, unsigned char *data, unsigned int offset, unsigned int length);
+void KeccakP1600_ExtractAndAddBytes(const void *state, const unsigned char *input, unsigned char *output, unsigned int offset, unsigned int length);
+size_t KeccakF1600_FastLoop_Absorb(void *state, unsigned int laneCount, const unsigned char *data, size_t dataByteLen);
+
+/** Name of the backend selected for this CPU. */
+const char* KeccakP1600_backend(void);
+
+/**
+ * Selects the backend with the short name "opt64", "avx2" or "avx512" instead, e.g. for testing.
+ * No Keccak state may be in use, as the backends lay out the state differently.
+ * Returns 0 if successful and -1 if the name is unknown or the CPU does not support the backend.
+ */
+int KeccakP1600_select_backend(const char* name);
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * Runtime dispatch of the KeccakP-1600 interface (see KeccakP-1600-SnP.h) to the fastest
+ * backend supported by the CPU. The backends are compiled with KeccakP-1600-rename.h so that
+ * their functions carry the backend name:
+ *   opt64  - generic 64-bit optimized implementation, runs everywhere
+ *   avx2   - AVX2 implementation (x86-64 only)
+ *   avx512 - AVX-512 implementation (x86-64 only)
+ */
+
+#include <string.h>
+#include "KeccakP-1600-SnP.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define KECCAK_DISPATCH_X86
+#endif
+
+/* -------------------------------------------------- */
+/* Backends */
+
+typedef struct {
+	const char* name;
+	void (*initialize)(void* state);
+	void (*addBytes)(void* state, const unsigned char* data, unsigned int offset, unsigned int length);
+	void (*overwriteBytes)(void* state, const unsigned char* data, unsigned int offset, unsigned int length);
+	void (*overwriteWithZeroes)(void* state, unsigned int byteCount);
+	void (*permuteNrounds)(void* state, unsigned int nrounds);
+	void (*permute12rounds)(void* state);
+	void (*permute24rounds)(void* state);
+	void (*extractBytes)(const void* state, unsigned char* data, unsigned int offset, unsigned int length);
+	void (*extractAndAddBytes)(const void* state, const unsigned char* input, unsigned char* output, unsigned int offset, unsigned int length);
+	size_t (*fastLoopAbsorb)(void* state, unsigned int laneCount, const unsigned char* data, size_t dataByteLen);
+} KeccakP1600Backend;
+
+// declares the functions of one backend, the AVX2 backend takes offsets and lengths as size_t
+#define KECCAK_BACKEND_DECLARE(backend, sizeType) \
+	void KeccakP1600_##backend##_Initialize(void* state); \
+	void KeccakP1600_##backend##_AddBytes(void* state, const unsigned char* data, sizeType offset, sizeType length); \
+	void KeccakP1600_##backend##_OverwriteBytes(void* state, const unsigned char* data, sizeType offset, sizeType length); \
+	void KeccakP1600_##backend##_OverwriteWithZeroes(void* state, sizeType byteCount); \
+	void KeccakP1600_##backend##_Permute_Nrounds(void* state, unsigned int nrounds); \
+	void KeccakP1600_##backend##_Permute_12rounds(void* state); \
+	void KeccakP1600_##backend##_Permute_24rounds(void* state); \
+	void KeccakP1600_##backend##_ExtractBytes(const void* state, unsigned char* data, sizeType offset, sizeType length); \
+	void KeccakP1600_##backend##_ExtractAndAddBytes(const void* state, const unsigned char* input, unsigned char* output, sizeType offset, sizeType length); \
+	size_t KeccakP1600_##backend##_FastLoop_Absorb(void* state, sizeType laneCount, const unsigned char* data, size_t dataByteLen);
+
+#define KECCAK_BACKEND_TABLE(backend, name) { \
+	name, \
+	KeccakP1600_##backend##_Initialize, \
+	KeccakP1600_##backend##_AddBytes, \
+	KeccakP1600_##backend##_OverwriteBytes, \
+	KeccakP1600_##backend##_OverwriteWithZeroes, \
+	KeccakP1600_##backend##_Permute_Nrounds, \
+	KeccakP1600_##backend##_Permute_12rounds, \
+	KeccakP1600_##backend##_Permute_24rounds, \
+	KeccakP1600_##backend##_ExtractBytes, \
+	KeccakP1600_##backend##_ExtractAndAddBytes, \
+	KeccakP1600_##backend##_FastLoop_Absorb \
+}
+
+KECCAK_BACKEND_DECLARE(opt64, unsigned int)
+static const KeccakP1600Backend keccak_opt64 = KECCAK_BACKEND_TABLE(opt64, "generic 64-bit optimized");
+
+#ifdef KECCAK_DISPATCH_X86
+KECCAK_BACKEND_DECLARE(avx512, unsigned int)
+static const KeccakP1600Backend keccak_avx512 = KECCAK_BACKEND_TABLE(avx512, "AVX-512");
+
+KECCAK_BACKEND_DECLARE(avx2, size_t)
+
+// adapt the size_t arguments of the AVX2 backend to the unsigned int arguments of the interface
+static void keccak_avx2_AddBytes(void* state, const unsigned char* data, unsigned int offset, unsigned int length)
+{
+	KeccakP1600_avx2_AddBytes(state, data, offset, length);
+}
+
+static void keccak_avx2_OverwriteBytes(void* state, const unsigned char* data, unsigned int offset, unsigned int length)
+{
+	KeccakP1600_avx2_OverwriteBytes(state, data, offset, length);
+}
+
+static void keccak_avx2_OverwriteWithZeroes(void* state, unsigned int byteCount)
+{
+	KeccakP1600_avx2_OverwriteWithZeroes(state, byteCount);
+}
+
+static void keccak_avx2_ExtractBytes(const void* state, unsigned char* data, unsigned int offset, unsigned int length)
+{
+	KeccakP1600_avx2_ExtractBytes(state, data, offset, length);
+}
+
+static void keccak_avx2_ExtractAndAddBytes(const void* state, const unsigned char* input, unsigned char* output, unsigned int offset, unsigned int length)
+{
+	KeccakP1600_avx2_ExtractAndAddBytes(state, input, output, offset, length);
+}
+
+static size_t keccak_avx2_FastLoop_Absorb(void* state, unsigned int laneCount, const unsigned char* data, size_t dataByteLen)
+{
+	return KeccakP1600_avx2_FastLoop_Absorb(state, laneCount, data, dataByteLen);
+}
+
+static const KeccakP1600Backend keccak_avx2 = {
+	"AVX2",
+	KeccakP1600_avx2_Initialize,
+	keccak_avx2_AddBytes,
+	keccak_avx2_OverwriteBytes,
+	keccak_avx2_OverwriteWithZeroes,
+	KeccakP1600_avx2_Permute_Nrounds,
+	KeccakP1600_avx2_Permute_12rounds,
+	KeccakP1600_avx2_Permute_24rounds,
+	keccak_avx2_ExtractBytes,
+	keccak_avx2_ExtractAndAddBytes,
+	keccak_avx2_FastLoop_Absorb
+};
+#endif // KECCAK_DISPATCH_X86
+
+// the generic backend until the selection below has run
+static const KeccakP1600Backend* keccak_backend = &keccak_opt64;
+
+// Selects the fastest backend supported by the CPU, this runs once when the program is loaded.
+__attribute__((constructor))
+static void keccak_select_backend()
+{
+#ifdef KECCAK_DISPATCH_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		keccak_backend = &keccak_avx512;
+	} else if (__builtin_cpu_supports("avx2")) {
+		keccak_backend = &keccak_avx2;
+	}
+#endif // KECCAK_DISPATCH_X86
+}
+
+const char* KeccakP1600_backend(void)
+{
+	return keccak_backend->name;
+}
+
+int KeccakP1600_select_backend(const char* name)
+{
+	if (strcmp(name, "opt64") == 0) {
+		keccak_backend = &keccak_opt64;
+		return 0;
+	}
+#ifdef KECCAK_DISPATCH_X86
+	__builtin_cpu_init();
+	if ((strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+		keccak_backend = &keccak_avx2;
+		return 0;
+	}
+	if ((strcmp(name, "avx512") == 0) && __builtin_cpu_supports("avx512f")) {
+		keccak_backend = &keccak_avx512;
+		return 0;
+	}
+#endif // KECCAK_DISPATCH_X86
+	return -1;
+}
+
+/* -------------------------------------------------- */
+/* Interface */
+
+void KeccakP1600_Initialize(void* state)
+{
+	keccak_backend->initialize(state);
+}
+
+void KeccakP1600_AddByte(void* state, unsigned char data, unsigned int offset)
+{
+	keccak_backend->addBytes(state, &data, offset, 1);
+}
+
+void KeccakP1600_AddBytes(void* state, const unsigned char* data, unsigned int offset, unsigned int length)
+{
+	keccak_backend->addBytes(state, data, offset, length);
+}
+
+void KeccakP1600_OverwriteBytes(void* state, const unsigned char* data, unsigned int offset, unsigned int length)
+{
+	keccak_backend->overwriteBytes(state, data, offset, length);
+}
+
+void KeccakP1600_OverwriteWithZeroes(void* state, unsigned int byteCount)
+{
+	keccak_backend->overwriteWithZeroes(state, byteCount);
+}
+
+void KeccakP1600_Permute_Nrounds(void* state, unsigned int nrounds)
+{
+	keccak_backend->permuteNrounds(state, nrounds);
+}
+
+void KeccakP1600_Permute_12rounds(void* state)
+{
+	keccak_backend->permute12rounds(state);
+}
+
+void KeccakP1600_Permute_24rounds(void* state)
+{
+	keccak_backend->permute24rounds(state);
+}
+
+void KeccakP1600_ExtractBytes(const void* state, unsigned char* data, unsigned int offset, unsigned int length)
+{
+	keccak_backend->extractBytes(state, data, offset, length);
+}
+
+void KeccakP1600_ExtractAndAddBytes(const void* state, const unsigned char* input, unsigned char* output, unsigned int offset, unsigned int length)
+{
+	keccak_backend->extractAndAddBytes(state, input, output, offset, length);
+}
+
+size_t KeccakF1600_FastLoop_Absorb(void* state, unsigned int laneCount, const unsigned char* data, size_t dataByteLen)
+{
+	return keccak_backend->fastLoopAbsorb(state, laneCount, data, dataByteLen);
+}
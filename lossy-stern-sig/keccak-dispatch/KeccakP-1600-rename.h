@@ -0,0 +1,42 @@
+/*
+ * Forced include (-include) for compiling one KeccakP-1600 backend of the Keccak Code Package
+ * under its own symbol names, so that several backends can be linked into the same binary.
+ * KECCAK_BACKEND must be defined to the short backend name, e.g. -DKECCAK_BACKEND=avx512
+ * renames KeccakP1600_Initialize to KeccakP1600_avx512_Initialize.
+ */
+
+#ifndef _KeccakP_1600_rename_h_
+#define _KeccakP_1600_rename_h_
+
+#define KECCAK_BACKEND_NAME2(backend, name) KeccakP1600_##backend##_##name
+#define KECCAK_BACKEND_NAME(backend, name) KECCAK_BACKEND_NAME2(backend, name)
+
+#define KeccakP1600_Initialize KECCAK_BACKEND_NAME(KECCAK_BACKEND, Initialize)
+#define KeccakP1600_AddBytes KECCAK_BACKEND_NAME(KECCAK_BACKEND, AddBytes)
+#define KeccakP1600_OverwriteBytes KECCAK_BACKEND_NAME(KECCAK_BACKEND, OverwriteBytes)
+#define KeccakP1600_OverwriteWithZeroes KECCAK_BACKEND_NAME(KECCAK_BACKEND, OverwriteWithZeroes)
+#define KeccakP1600_Permute_Nrounds KECCAK_BACKEND_NAME(KECCAK_BACKEND, Permute_Nrounds)
+#define KeccakP1600_Permute_12rounds KECCAK_BACKEND_NAME(KECCAK_BACKEND, Permute_12rounds)
+#define KeccakP1600_Permute_24rounds KECCAK_BACKEND_NAME(KECCAK_BACKEND, Permute_24rounds)
+#define KeccakP1600_ExtractBytes KECCAK_BACKEND_NAME(KECCAK_BACKEND, ExtractBytes)
+#define KeccakP1600_ExtractAndAddBytes KECCAK_BACKEND_NAME(KECCAK_BACKEND, ExtractAndAddBytes)
+#define KeccakF1600_FastLoop_Absorb KECCAK_BACKEND_NAME(KECCAK_BACKEND, FastLoop_Absorb)
+#define KeccakP1600_12rounds_FastLoop_Absorb KECCAK_BACKEND_NAME(KECCAK_BACKEND, 12rounds_FastLoop_Absorb)
+#define KeccakP1600RoundConstants KECCAK_BACKEND_NAME(KECCAK_BACKEND, RoundConstants)
+#define KeccakP1600_AddBytesInLane KECCAK_BACKEND_NAME(KECCAK_BACKEND, AddBytesInLane)
+#define KeccakP1600_AddLanes KECCAK_BACKEND_NAME(KECCAK_BACKEND, AddLanes)
+#define KeccakP1600_OverwriteBytesInLane KECCAK_BACKEND_NAME(KECCAK_BACKEND, OverwriteBytesInLane)
+#define KeccakP1600_OverwriteLanes KECCAK_BACKEND_NAME(KECCAK_BACKEND, OverwriteLanes)
+#define KeccakP1600_ExtractBytesInLane KECCAK_BACKEND_NAME(KECCAK_BACKEND, ExtractBytesInLane)
+#define KeccakP1600_ExtractLanes KECCAK_BACKEND_NAME(KECCAK_BACKEND, ExtractLanes)
+#define KeccakP1600_ExtractAndAddBytesInLane KECCAK_BACKEND_NAME(KECCAK_BACKEND, ExtractAndAddBytesInLane)
+#define KeccakP1600_ExtractAndAddLanes KECCAK_BACKEND_NAME(KECCAK_BACKEND, ExtractAndAddLanes)
+
+// the AVX2 backend implements these as functions, the 64-bit and AVX-512 backends define them as macros
+#ifdef KECCAK_BACKEND_AVX2
+#define KeccakP1600_StaticInitialize KECCAK_BACKEND_NAME(KECCAK_BACKEND, StaticInitialize)
+#define KeccakP1600_AddByte KECCAK_BACKEND_NAME(KECCAK_BACKEND, AddByte)
+#define keccak_rc KECCAK_BACKEND_NAME(KECCAK_BACKEND, rc)
+#endif
+
+#endif
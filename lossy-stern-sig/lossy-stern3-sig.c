@@ -10,6 +10,11 @@
 #include "rng.h"
 #endif
 
+#if defined(USE_X86_SIMD_KERNELS) && defined(__x86_64__) && defined(__GNUC__)
+#define X86_SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
 /* -------------------------------------------------- */
 /* Computation of Hamming weight and parity */
 
@@ -37,71 +42,166 @@ const size_t Hamming_weight[256] =
 /* -------------------------------------------------- */
 /* Randomness */
 
+// see the section on memory for secret data
+void zeroize(void* buf, size_t len);
+
 #ifndef NIST_API
 // The size of the seed for the randomness pool (in bytes).
 size_t rand_seedByteLen = 256/8;
-// The Keccak hash instance used to expand the seed.
-Keccak_HashInstance rand_KeccakHashInstance;
+// The number of bytes a randomness pool outputs before it is reseeded from the operating system.
+size_t rand_reseedByteLen = 1<<24;
 
-// Initialize the randomness pool.
-int rand_init()
+// The randomness pool of one thread, a SHAKE-256 instance seeded from the operating system.
+typedef struct {
+	// the Keccak hash instance used to expand the seed
+	Keccak_HashInstance hashInstance;
+	// true if the pool has been seeded
+	bool seeded;
+	// the value of rand_forkGeneration when the pool was seeded
+	size_t forkGeneration;
+	// the value of rand_backendGeneration when the pool was seeded
+	size_t backendGeneration;
+	// the number of bytes output since the pool was seeded
+	size_t outputByteLen;
+} RandPool;
+
+// Every thread has its own randomness pool, thus no lock is needed.
+_Thread_local RandPool rand_pool;
+// Incremented in the child process after a fork, such that the child reseeds instead of repeating the output of the parent.
+atomic_size_t rand_forkGeneration = 0;
+// Incremented by set_kernels(), such that every thread reseeds its pool instead of squeezing a Keccak state that is laid out for the previous backend.
+atomic_size_t rand_backendGeneration = 0;
+// Registers the fork handler and the key for overwriting the pool of a terminating thread, once.
+pthread_once_t rand_once = PTHREAD_ONCE_INIT;
+pthread_key_t rand_key;
+
+void rand_fork_child()
 {
-	// read some random data from /dev/urandom
-	unsigned char* rand_seed = calloc(rand_seedByteLen, sizeof(unsigned char));
-	int randData = open("/dev/urandom", O_RDONLY);
-	if (randData < 0) {
-		free(rand_seed);
-		return -1;
-	} else {
-		ssize_t res = read(randData, rand_seed, rand_seedByteLen);
+	atomic_fetch_add(&rand_forkGeneration, 1);
+}
+
+// Overwrites the pool of a terminating thread.
+void rand_pool_wipe(void* pool)
+{
+	zeroize(pool, sizeof(RandPool));
+}
+
+void rand_setup()
+{
+	pthread_atfork(NULL, NULL, rand_fork_child);
+	pthread_key_create(&rand_key, rand_pool_wipe);
+}
+
+// Reads seedByteLen random bytes from the operating system.
+// Uses getrandom() and falls back to /dev/urandom if the kernel does not provide it.
+int rand_read_os(unsigned char* seed, size_t seedByteLen)
+{
+	size_t done = 0;
+	while (done < seedByteLen) {
+		ssize_t res = getrandom(seed + done, seedByteLen - done, 0);
 		if (res < 0) {
-			free(rand_seed);
-			return -1;
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != ENOSYS) {
+				return -1;
+			}
+			// read from /dev/urandom instead
+			int randData = open("/dev/urandom", O_RDONLY);
+			if (randData < 0) {
+				return -1;
+			}
+			while (done < seedByteLen) {
+				res = read(randData, seed + done, seedByteLen - done);
+				if (res <= 0) {
+					close(randData);
+					return -1;
+				}
+				done += res;
+			}
+			close(randData);
+			break;
 		}
-		close(randData);
+		done += res;
 	}
 
-	// init the Keccak hash instance
-	if (Keccak_HashInitialize_SHAKE256(&rand_KeccakHashInstance) != SUCCESS) {
-		// the initialization was unsuccessful
-		free(rand_seed);
+	// successful execution
+	return 0;
+}
+
+// (Re)seeds a randomness pool from the operating system.
+int rand_seed(RandPool* pool)
+{
+	pthread_once(&rand_once, rand_setup);
+
+	// detect failures, e.g. evaluating SHAKE
+	bool fail = false;
+
+	unsigned char seed[rand_seedByteLen];
+	if (rand_read_os(seed, rand_seedByteLen) != 0) {
 		return -1;
 	}
+
+	// init the Keccak hash instance
+	if (Keccak_HashInitialize_SHAKE256(&pool->hashInstance) != SUCCESS) { fail = true; };
 	// feed the random seed
-	if (Keccak_HashUpdate(&rand_KeccakHashInstance, rand_seed, rand_seedByteLen * 8) != SUCCESS) { // specify the seed length in bits
-		// the updating was unsuccessful
-		free(rand_seed);
-		return -1;
-	}
+	if (Keccak_HashUpdate(&pool->hashInstance, seed, rand_seedByteLen * 8) != SUCCESS) { fail = true; }; // specify the seed length in bits
 	// finalize the Keccak hash instance, prepare for squeezing the digest
-	if (Keccak_HashFinal(&rand_KeccakHashInstance, NULL) != SUCCESS) { // don't extract the digest here, squeeze later
-		// the finalization was unsuccessful
-		free(rand_seed);
+	if (Keccak_HashFinal(&pool->hashInstance, NULL) != SUCCESS) { fail = true; }; // don't extract the digest here, squeeze later
+	zeroize(seed, rand_seedByteLen);
+
+	if (fail) {
+		pool->seeded = false;
 		return -1;
 	}
-
-	free(rand_seed);
+	pool->seeded = true;
+	pool->forkGeneration = atomic_load_explicit(&rand_forkGeneration, memory_order_relaxed);
+	pool->backendGeneration = atomic_load_explicit(&rand_backendGeneration, memory_order_relaxed);
+	pool->outputByteLen = 0;
+	pthread_setspecific(rand_key, pool);
 
 	// successful execution
 	return 0;
 }
 
-// Access the randomness pool.
+// Initialize the randomness pool of the calling thread.
+int rand_init()
+{
+	return rand_seed(&rand_pool);
+}
+
+// Access the randomness pool of the calling thread.
 int get_randomness(unsigned char* buf, size_t bufByteLen)
 {
+	RandPool* pool = &rand_pool;
+
+	// seed the pool on first use in this thread, after a fork, after a change of the Keccak backend and after rand_reseedByteLen bytes of output
+	if (!pool->seeded || (pool->forkGeneration != atomic_load_explicit(&rand_forkGeneration, memory_order_relaxed)) || (pool->backendGeneration != atomic_load_explicit(&rand_backendGeneration, memory_order_relaxed)) || (pool->outputByteLen >= rand_reseedByteLen)) {
+		if (rand_seed(pool) != 0) {
+			return -1;
+		}
+	}
+
 	// squeeze the Keccak hash instance to get the SHAKE-256 generated bytes
-	if (Keccak_HashSqueeze(&rand_KeccakHashInstance, buf, bufByteLen * 8) != SUCCESS) { // specify digest length in bits
+	if (Keccak_HashSqueeze(&pool->hashInstance, buf, bufByteLen * 8) != SUCCESS) { // specify digest length in bits
 		// something went wrong in the evaluation of the hash function
 		return -1;
 	}
+	pool->outputByteLen += bufByteLen;
 
 	// successful execution
 	return 0;
 }
 #else // NIST_API
+// Serializes the access to the randomness of the NIST API, which is shared by all threads (e.g. the workers of a PresigPool).
+pthread_mutex_t rand_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 int get_randomness(unsigned char* buf, size_t bufByteLen)
 {
-	if (randombytes(buf, bufByteLen) == RNG_SUCCESS) {
+	pthread_mutex_lock(&rand_mutex);
+	int res = randombytes(buf, bufByteLen);
+	pthread_mutex_unlock(&rand_mutex);
+	if (res == RNG_SUCCESS) {
 		return 0;
 	} else {
 		return -1;
@@ -109,190 +209,250 @@ int get_randomness(unsigned char* buf, size_t bufByteLen)
 }
 #endif // NIST_API
 
-// Returns a uniform integer in the set {0,...,bound-1}.
-int get_rand_uint(size_t bound, size_t* res, Keccak_HashInstance* hashInstance)
+/* -------------------------------------------------- */
+/* SHAKE256 of several inputs at once */
+
+#ifdef X86_SIMD_KERNELS
+// The parallel Keccak-p[1600] permutations of the bundled Keccak Code Package (PlSnP/KeccakP-1600-times4/SIMD256 and
+// PlSnP/KeccakP-1600-times8/SIMD512), compiled separately for AVX2 and AVX-512 (see the Makefile).
+void KeccakP1600times4_InitializeAll(void* states);
+void KeccakP1600times4_AddBytes(void* states, unsigned int instanceIndex, const unsigned char* data, unsigned int offset, unsigned int length);
+void KeccakP1600times4_PermuteAll_24rounds(void* states);
+void KeccakP1600times4_ExtractBytes(const void* states, unsigned int instanceIndex, unsigned char* data, unsigned int offset, unsigned int length);
+void KeccakP1600times8_InitializeAll(void* states);
+void KeccakP1600times8_AddBytes(void* states, unsigned int instanceIndex, const unsigned char* data, unsigned int offset, unsigned int length);
+void KeccakP1600times8_PermuteAll_24rounds(void* states);
+void KeccakP1600times8_ExtractBytes(const void* states, unsigned int instanceIndex, unsigned char* data, unsigned int offset, unsigned int length);
+#endif // X86_SIMD_KERNELS
+
+// the rate of SHAKE256 in bytes
+#define SHAKE256_RATE 136
+// the maximal number of parallel instances of Keccak-p[1600]
+#define SHAKE_MAX_LANES 8
+
+// Parallel instances of Keccak-p[1600], on which SHAKE256 runs for several inputs at once.
+typedef struct ShakeLanes {
+	size_t lanes;
+	void (*initialize_all)(void* states);
+	void (*add_bytes)(void* states, unsigned int instanceIndex, const unsigned char* data, unsigned int offset, unsigned int length);
+	void (*permute_all)(void* states);
+	void (*extract_bytes)(const void* states, unsigned int instanceIndex, unsigned char* data, unsigned int offset, unsigned int length);
+	// used for the remaining inputs, if fewer than lanes, or NULL
+	const struct ShakeLanes* fallback;
+} ShakeLanes;
+
+#ifdef X86_SIMD_KERNELS
+const ShakeLanes shake_times4 = { 4, KeccakP1600times4_InitializeAll, KeccakP1600times4_AddBytes,
+	KeccakP1600times4_PermuteAll_24rounds, KeccakP1600times4_ExtractBytes, NULL };
+const ShakeLanes shake_times8 = { 8, KeccakP1600times8_InitializeAll, KeccakP1600times8_AddBytes,
+	KeccakP1600times8_PermuteAll_24rounds, KeccakP1600times8_ExtractBytes, &shake_times4 };
+#endif // X86_SIMD_KERNELS
+
+// The parallel instances used, selected at runtime (see select_kernels), or NULL to only use the serial SHAKE256.
+const ShakeLanes* shake_lanes_impl = NULL;
+
+// Computes SHAKE256 of impl->lanes inputs of inputByteLen bytes at once, with outputByteLen bytes of output each.
+void shake256_lanes(const ShakeLanes* impl, unsigned char* const* out, size_t outputByteLen, const unsigned char* const* in, size_t inputByteLen)
 {
-	// catch special cases
-	if (bound == 0) {
-		return -1;
+	_Alignas(64) unsigned char states[SHAKE_MAX_LANES * 200];
+	const unsigned char suffix = 0x1F; // domain separation of SHAKE and the first bit of the padding
+	const unsigned char last = 0x80; // the last bit of the padding
+
+	impl->initialize_all(states);
+	// absorb
+	size_t pos = 0;
+	for (; inputByteLen - pos >= SHAKE256_RATE; pos += SHAKE256_RATE) {
+		for (size_t l=0; l<impl->lanes; l++) {
+			impl->add_bytes(states, l, in[l] + pos, 0, SHAKE256_RATE);
+		}
+		impl->permute_all(states);
 	}
-	if (bound == 1) {
-		*res = 0;
-		return 0;
+	for (size_t l=0; l<impl->lanes; l++) {
+		impl->add_bytes(states, l, in[l] + pos, 0, inputByteLen - pos);
+		impl->add_bytes(states, l, &suffix, inputByteLen - pos, 1);
+		impl->add_bytes(states, l, &last, SHAKE256_RATE - 1, 1);
 	}
-
-	// the number of bits necessary to store a number in {0,...,bound-1}
-	size_t no_bits = (size_t)(ceil(log2((double)bound)));
-	// the number of necessary bytes
-	size_t no_bytes = (no_bits+7)/8;
-	unsigned char* buf = calloc(no_bytes, sizeof(unsigned char));
-	// try to generate a number in {0,...,bound-1}
-	// - randomly generate a number in {0,...,2^no_bits-1}
-	// - if >= bound, the number needs to be discarded to ensure a uniform distribution
-	// at least half of the generated numbers are < bound,
-	// thus, the expected number of iterations of the following loop is <= 2
+	impl->permute_all(states);
+	// squeeze
+	pos = 0;
 	while (true) {
-		// get randomness from the hash instance
-		if (Keccak_HashSqueeze(hashInstance, buf, no_bytes*8) != SUCCESS) {
-			// something went wrong
-			free(buf);
-			return -1;
+		size_t len = (outputByteLen - pos < SHAKE256_RATE) ? outputByteLen - pos : SHAKE256_RATE;
+		for (size_t l=0; l<impl->lanes; l++) {
+			impl->extract_bytes(states, l, out[l] + pos, 0, len);
 		}
-		// transform the relevant bits to size_t
-		size_t temp = 0;
-		for (int i=0; i<no_bytes-1; i++) { // all bytes in the buffer except for the last
-			temp += ((size_t)buf[i])<<(i*8);
-		}
-		// mask the last byte to extract the valid bits
-		temp += (((size_t)(buf[no_bytes-1])) & ((1<<(((no_bits+7)%8)+1))-1)) << ((no_bytes-1)*8);
-		// check if temp matches the bound
-		if (temp < bound) {
-			// success, exit loop
-			*res = temp;
+		pos += len;
+		if (pos == outputByteLen) {
 			break;
 		}
+		impl->permute_all(states);
 	}
+	zeroize(states, sizeof(states));
+}
 
-	free(buf);
+// Computes out[i] = SHAKE256(in[i]) for i=0,...,count-1, where all inputs have inputByteLen bytes
+// and all outputs have outputByteLen bytes. Runs on parallel instances of Keccak-p[1600] if available.
+// returns 0 if successful and -1 otherwise
+int shake256_many(unsigned char* const* out, size_t outputByteLen, const unsigned char* const* in, size_t inputByteLen, size_t count)
+{
+	// detect failures evaluating SHAKE
+	bool fail = false;
 
-	// successful execution
-	return 0;
+	size_t i = 0;
+	for (const ShakeLanes* impl = shake_lanes_impl; impl != NULL; impl = impl->fallback) {
+		for (; i + impl->lanes <= count; i += impl->lanes) {
+			shake256_lanes(impl, out + i, outputByteLen, in + i, inputByteLen);
+		}
+	}
+	for (; i<count; i++) {
+		if (SHAKE256(out[i], outputByteLen, in[i], inputByteLen) != 0) { fail = true; };
+	}
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
 }
 
 /* -------------------------------------------------- */
-/* Application of a permutation to a vector of n bits */
+/* SHAKE256 output in small pieces */
 
-// In-place binary MSD radix sort.
-// begin points to the first element, end points to the element behind the list
-// no_bit: the bit to start with (counting no_bit=1 as the most significant bit)
-// returns true in case of a collision (ignoring the last bit), false otherwise
-#ifdef PERMUTATIONS_USE_64BIT
-bool radix_sort_aux(uint64_t* begin, uint64_t* end, size_t no_bit)
-#else
-bool radix_sort_aux(uint32_t* begin, uint32_t* end, size_t no_bit)
-#endif
+// SHAKE256 output of one input, squeezed one block at a time and handed out in bytes or bits.
+typedef struct {
+	Keccak_HashInstance hashInstance;
+	// the current block of output, the bytes before blockPos are used up
+	unsigned char block[SHAKE256_RATE];
+	size_t blockPos;
+	// bits of the output that are taken from the block but not handed out yet, starting at the least significant bit
+	uint64_t bits;
+	size_t numBits;
+} ShakeReader;
+
+// Sets up reader to hand out SHAKE256(in).
+// returns 0 if successful and -1 otherwise
+int shake_reader_init(ShakeReader* reader, const unsigned char* in, size_t inByteLen)
 {
-	// break recursion
-	if ((end - begin) <= 1) {
-		// at most one element left, therefore no collision
-		return false;
+	// detect failures evaluating SHAKE
+	bool fail = false;
+
+	if (Keccak_HashInitialize_SHAKE256(&reader->hashInstance) != SUCCESS) { fail = true; };
+	if (Keccak_HashUpdate(&reader->hashInstance, in, inByteLen * 8) != SUCCESS) { fail = true; };
+	if (Keccak_HashFinal(&reader->hashInstance, NULL) != SUCCESS) { fail = true; };
+	reader->blockPos = SHAKE256_RATE; // nothing squeezed yet
+	reader->bits = 0;
+	reader->numBits = 0;
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
 	}
-#ifdef PERMUTATIONS_USE_64BIT
-	if (no_bit >= 64) {
-#else
-	if (no_bit >= 32) {
-#endif
-		// more than one element left, and already all bits except for the last compared
-		// hence, we found a collision
-		return true;
+}
+
+// Makes sure that the block of reader has an unused byte.
+// returns 0 if successful and -1 otherwise
+int shake_reader_fill(ShakeReader* reader)
+{
+	if (reader->blockPos == SHAKE256_RATE) {
+		if (Keccak_HashSqueeze(&reader->hashInstance, reader->block, SHAKE256_RATE * 8) != SUCCESS) {
+			return -1;
+		}
+		reader->blockPos = 0;
 	}
+	return 0;
+}
 
-	// divide into buckets
-#ifdef PERMUTATIONS_USE_64BIT
-	uint64_t mask = ((uint64_t)1)<<(64-no_bit);
-	uint64_t* end_bucket0 = begin;
-	uint64_t* begin_bucket1 = end;
-	uint64_t temp;
-#else
-	uint32_t mask = ((uint32_t)1)<<(32-no_bit);
-	uint32_t* end_bucket0 = begin;
-	uint32_t* begin_bucket1 = end;
-	uint32_t temp;
-#endif
-	while (end_bucket0 != begin_bucket1) {
-		if (((*end_bucket0) & mask) == 0) {
-			end_bucket0++;
-		} else {
-			begin_bucket1--;
-			temp = (*end_bucket0);
-			(*end_bucket0) = (*begin_bucket1);
-			(*begin_bucket1) = temp;
+// Writes the next outByteLen bytes of output to out. Bits that are left over from shake_reader_bits() are discarded,
+// hence the bytes are the same as from Keccak_HashSqueeze() if the bits handed out before fill whole bytes.
+// returns 0 if successful and -1 otherwise
+int shake_reader_bytes(ShakeReader* reader, unsigned char* out, size_t outByteLen)
+{
+	reader->bits = 0;
+	reader->numBits = 0;
+	size_t pos = 0;
+	while (pos < outByteLen) {
+		if (shake_reader_fill(reader) != 0) {
+			return -1;
 		}
+		size_t len = (outByteLen - pos < SHAKE256_RATE - reader->blockPos) ? outByteLen - pos : SHAKE256_RATE - reader->blockPos;
+		memcpy(out + pos, reader->block + reader->blockPos, len);
+		reader->blockPos += len;
+		pos += len;
 	}
+	return 0;
+}
 
-	// sort the buckets (considering the next less significant bit)
-	bool collision = false;
-	collision = collision || radix_sort_aux(begin, end_bucket0, no_bit+1);
-	collision = collision || radix_sort_aux(begin_bucket1, end, no_bit+1);
-	return collision;
+// Writes the next numBits bits of output to *res, the first bit is the least significant one.
+// The bits are taken from the bytes of the output in order, starting at the least significant bit of each byte.
+// note: numBits <= 56
+// returns 0 if successful and -1 otherwise
+int shake_reader_bits(ShakeReader* reader, size_t numBits, uint64_t* res)
+{
+	while (reader->numBits < numBits) {
+		if (shake_reader_fill(reader) != 0) {
+			return -1;
+		}
+		reader->bits |= ((uint64_t) reader->block[reader->blockPos]) << reader->numBits;
+		reader->blockPos++;
+		reader->numBits += 8;
+	}
+	*res = reader->bits & ((((uint64_t) 1) << numBits) - 1);
+	reader->bits >>= numBits;
+	reader->numBits -= numBits;
+	return 0;
 }
 
-// This function encapsulates the radix sort auxiliary function.
-// data points to the beginning of the list to sort
-// len specifies the number of elements in the list
-// returns true in case of a collision (ignoring the last bit), false otherwise
-#ifdef PERMUTATIONS_USE_64BIT
-bool radix_sort(uint64_t* data, size_t len)
-#else
-bool radix_sort(uint32_t* data, size_t len)
-#endif
+// Returns the number of bits necessary to store the numbers {0,...,x}, i.e. the position of the highest set bit of x.
+size_t bit_length(size_t x)
 {
-	return radix_sort_aux(data, data+len, 1);
+	size_t no_bits = 0;
+	while (x >> no_bits) {
+		no_bits++;
+	}
+	return no_bits;
 }
 
-// Applies a permutatation to a word on bit-level.
-// seedPerm determines the permutation
-// word has an assumed length of p->n bits
+// Samples a uniformly distributed vector of n bits and weight w from the output of reader.
+// For position i, a uniform integer t in {0,...,n-i-1} is drawn by rejection sampling from the next ceil(log2(n-i)) bits,
+// rounded up to whole bytes, and the bit is set if t is smaller than the number of ones that are still to be placed.
+// Whether a bit is set is computed without branches; only the rejections show in the timing and they depend on discarded numbers only.
+// note: res needs to provide at least (n+7)/8 bytes, w <= n
 // returns 0 if successful and -1 otherwise
-int apply_permutation(const Params* p, const unsigned char* seedPerm, unsigned char* word)
+int sample_fixed_weight(size_t n, size_t w, ShakeReader* reader, unsigned char* res)
 {
 	// detect failures evaluating SHAKE
 	bool fail = false;
 
-#ifdef PERMUTATIONS_USE_64BIT
-	uint64_t* temp;
-#else
-	uint32_t* temp;
-#endif
-	// try to apply the permutation
-	// a failure occurs in the (unlikely) case of a collision in the sorting
-	// in case of a collision, we need to start over and try again
-	size_t try = 1;
-	while (true) {
-		// fill a list of p->n numbers by expanding the seed
-#ifdef PERMUTATIONS_USE_64BIT
-		temp = (uint64_t*) malloc(try * p->n * sizeof(uint64_t));
-		if (SHAKE256((unsigned char*) temp, try * p->n * sizeof(uint64_t), seedPerm, p->seedPermByteLen) != 0){ fail = true; };
-#else
-		temp = (uint32_t*) malloc(try * p->n * sizeof(uint32_t));
-		if (SHAKE256((unsigned char*) temp, try * p->n * sizeof(uint32_t), seedPerm, p->seedPermByteLen) != 0){ fail = true; };
-#endif
-
-		// set least significant bits of all numbers in temp
-		for (int i=0; i<p->n; i++) {
-#ifdef PERMUTATIONS_USE_64BIT
-			uint64_t wordBit = ( word[i/8] & (1<<(i%8)) )>>(i%8);
-			temp[(try-1)*p->n + i] = (temp[(try-1)*p->n + i] & 0xFFFFFFFFFFFFFFFE) | (wordBit & 0x0000000000000001);
-#else
-			uint32_t wordBit = ( word[i/8] & (1<<(i%8)) )>>(i%8);
-			temp[(try-1)*p->n + i] = (temp[(try-1)*p->n + i] & 0xFFFFFFFE) | (wordBit & 0x00000001);
-#endif
-		}
-
-		// sort numbers
-		bool collision = radix_sort(temp + (try-1)*p->n, p->n);
-
-		if (collision) {
-			free(temp);
-			try++;
-			// we need to start over and try again
-		} else {
-			break;
+	memset(res, 0, (n+7)/8);
+	size_t remaining = w; // the number of ones still to be placed
+	// the number of bits necessary to store a number in {0,...,bound-1}, it only decreases with the bound
+	size_t no_bits = bit_length(n - 1);
+	for (size_t i=0; i<n && !fail; i++) {
+		size_t bound = n - i;
+		if (no_bits > 0 && ((bound - 1) >> (no_bits - 1)) == 0) {
+			no_bits = bit_length(bound - 1);
 		}
+		// try to generate a number in {0,...,bound-1}
+		// - randomly generate a number in {0,...,2^no_bits-1}
+		// - if >= bound, the number needs to be discarded to ensure a uniform distribution
+		// at least half of the generated numbers are < bound,
+		// thus, the expected number of iterations of the following loop is <= 2
+		uint64_t t = 0;
+		do {
+			if (shake_reader_bits(reader, (no_bits+7)/8 * 8, &t) != 0) {
+				fail = true;
+				break;
+			}
+			t &= (((uint64_t) 1) << no_bits) - 1;
+		} while (t >= bound);
+		// set the bit if t < remaining, the difference wraps around exactly in this case
+		uint64_t bit = (t - remaining) >> 63;
+		res[i/8] |= (unsigned char) (bit << (i%8));
+		remaining -= bit;
 	}
 
-	// read least significant bits as one word
-	for (int i=0; i<p->n; i++) {
-#ifdef PERMUTATIONS_USE_64BIT
-		word[i/8] = (word[i/8] & (~(1<<(i%8)))) | ((temp[(try-1)*p->n + i] & 0x0000000000000001)<<(i%8));
-#else
-		word[i/8] = (word[i/8] & (~(1<<(i%8)))) | ((temp[(try-1)*p->n + i] & 0x00000001)<<(i%8));
-#endif
-	}
-
-	// clean up
-	free(temp);
-
 	// successful execution?
 	if (fail) {
 		return -1;
@@ -302,190 +462,2304 @@ int apply_permutation(const Params* p, const unsigned char* seedPerm, unsigned c
 }
 
 /* -------------------------------------------------- */
-/* Arithmetic in F_2 */
+/* Workspaces */
 
-// Performs the multiplication H*x on bit-level (in F_2) and write the result to res.
-// note: in res there must be space for at least p->r_in_bytes bytes
-void mult_H(const Params* p, unsigned char** H, const unsigned char* x, unsigned char* res)
+// alignment of every piece of a workspace, a cache line
+#define WS_ALIGNMENT 64
+
+// A block of memory that is handed out piece by piece, without any allocation.
+// If base is NULL, nothing is handed out but the size of the pieces is still counted,
+// hence the same function lays out a workspace and computes its size.
+typedef struct {
+	unsigned char* base;
+	size_t used;
+} Workspace;
+
+// Rounds len up to a multiple of WS_ALIGNMENT.
+static inline size_t ws_align(size_t len)
 {
-	// set res to zero
-	for (int i=0; i<p->r_in_bytes; i++) {
-		res[i] = 0;
-	}
-	// compute matrix-vector multiplication H*x = res
-	for (int i=0; i<p->r; i++) { // every iteration computes one bit of the result
-		// perform AND and compute parity
-		unsigned char b = 0;
-		for (int j=0; j<p->n_in_bytes; j++) {
-			b ^= Hamming_weight[x[j] & H[i][j]];
-		}
-		b &= 1; // get only the parity
-		res[i/8] = (res[i/8] & (~(1<<(i%8)))) | (b<<(i%8)); // insert bit into the result
-	}
+	return (len + WS_ALIGNMENT - 1) & ~((size_t) WS_ALIGNMENT - 1);
 }
 
-// Performs the addition x+y on bit-level (in F_2) and writes the result to res.
-// note: in res there must be space for at least p->n_in_bytes bytes
-void add_in_F2n(const Params* p, const unsigned char* x, const unsigned char* y, unsigned char* res)
+// Takes len bytes from the workspace, aligned to WS_ALIGNMENT.
+// returns a pointer to the bytes, or NULL if only the size is counted
+static inline void* ws_take(Workspace* ws, size_t len)
 {
-	// add (wrap in F_2)
-	for (int i=0; i<p->n_in_bytes; i++) {
-		res[i] = x[i] ^ y[i];
+	size_t offset = ws_align(ws->used);
+	ws->used = offset + len;
+	return (ws->base == NULL) ? NULL : ws->base + offset;
+}
+
+// Takes count arrays of len bytes each from the workspace, stored one after the other.
+// returns a pointer to count pointers to the arrays, or NULL if only the size is counted
+unsigned char** ws_take_arrays(Workspace* ws, size_t count, size_t len)
+{
+	unsigned char** arrays = (unsigned char**) ws_take(ws, count * sizeof(unsigned char*));
+	unsigned char* data = (unsigned char*) ws_take(ws, count * len);
+	if (arrays != NULL) {
+		for (size_t i=0; i<count; i++) {
+			arrays[i] = data + i * len;
+		}
 	}
+	return arrays;
 }
 
-// Performs the addition x+y on bit-level (in F_2) and writes the result to res.
-// note: in res there must be space for at least p->r_in_bytes bytes
-void add_in_F2r(const Params* p, const unsigned char* x, const unsigned char* y, unsigned char* res)
+// Allocates len bytes for a workspace, aligned to WS_ALIGNMENT.
+// returns a pointer to the zero-initialized memory, or NULL if the allocation failed
+void* ws_alloc(size_t len)
 {
-	// add (wrap in F_2)
-	for (int i=0; i<p->r_in_bytes; i++) {
-		res[i] = x[i] ^ y[i];
+	void* buf;
+	if (posix_memalign(&buf, WS_ALIGNMENT, len) != 0) {
+		return NULL;
 	}
+	memset(buf, 0, len);
+	return buf;
 }
 
 /* -------------------------------------------------- */
-/* Parameters */
+/* Application of a permutation to a vector of n bits */
 
-// Initialize the parameter set given by *p.
-int init_params(Params* p, size_t n, size_t r, size_t w, size_t t, size_t seedByteLen, size_t sigByteLen, size_t chHashByteLen)
-{
-	// set the parameters
-	p->n = n;
-	p->n_in_bytes = (p->n+7)/8;
-	p->r = r;
-	p->r_in_bytes = (p->r+7)/8;
-	p->w = w;
-	p->t = t;
-	p->seedSkByteLen = seedByteLen;
-	p->seedHByteLen = seedByteLen;
-	p->commByteLen = seedByteLen;
-	p->seedYByteLen = seedByteLen;
-	p->seedPermByteLen = seedByteLen;
-	p->coinsCommByteLen = seedByteLen;
-	p->sigByteLen = sigByteLen;
-	p->chHashByteLen = chHashByteLen;
-	p->skByteLen = p->seedSkByteLen;
-	p->pkByteLen = p->seedHByteLen + p->r_in_bytes;
+// A permutation is determined by sorting a list of p->n random numbers (keys), expanded from its seed.
+#ifdef PERMUTATIONS_USE_64BIT
+typedef uint64_t PermKey;
+#define PERM_KEY_BITS 64
+#else
+typedef uint32_t PermKey;
+#define PERM_KEY_BITS 32
+#endif
 
-	// successful execution
-	return 0;
+// Up to PERM_MAX_WORDS vectors can be permuted while the permutation is generated: their bits are carried through
+// the sorting network in the top bits of the original positions of the keys (see perm_sort), below are the positions.
+#define PERM_MAX_WORDS 8
+#define PERM_WORDS_SHIFT (PERM_KEY_BITS - PERM_MAX_WORDS)
+
+// A permutation of n bits, generated once from a seed and applied to any number of vectors.
+typedef struct {
+	// the number of bits
+	size_t n;
+	// bit i of the permuted vector is bit index[i] of the original vector
+	uint32_t* index;
+	// the following is only used while generating the permutation:
+	// the keys as expanded from the seed, sorted in place
+	PermKey* keys;
+	// the original position of each key, and the bits at this position of the vectors permuted along (see perm_sort),
+	// moved along with the keys
+	PermKey* keyIndex;
+#ifdef PERMUTATIONS_USE_BENES
+	// the permutation as a Beneš network on 2^logLen bits, where the bits beyond n stay in place:
+	size_t logLen;
+	// the control bits of the 2*logLen-1 layers, each a mask of 2^logLen bits (see perm_apply)
+	uint64_t* control;
+	// scratch memory for computing the control bits
+	uint32_t* work;
+	// scratch memory for applying the permutation to a packed vector
+	uint64_t* vec;
+#endif // PERMUTATIONS_USE_BENES
+} Permutation;
+
+// Sorting network (Batcher's merge exchange, in the formulation of djbsort), sorting the keys together with their indices.
+// The sequence of comparisons only depends on the number of keys, and every comparison is branch-free,
+// thus the timing does not depend on the keys.
+// For each p = top, top/2, ..., 1 (top being the largest power of two below n), the network
+// - compares x[j] and x[j+p], for all j with bit p clear, and then
+// - compares x[j+p] successively with x[j+r], r = top, top/2, ..., 2p, for all j with bit p clear, in ascending order of j,
+// where comparisons beyond the n keys are left out.
+
+// Returns 1 if a > b and 0 otherwise, without branching.
+static inline PermKey perm_key_gt(PermKey a, PermKey b)
+{
+	return (b ^ ((b ^ a) | ((b - a) ^ a))) >> (PERM_KEY_BITS - 1);
 }
 
-// Initializes a parameter set for 64-bit post-quantum security.
-int init_params_64pq(Params* p)
+// Sorts the two keys *a and *b, and their indices *ia and *ib along with them.
+static inline void perm_minmax(PermKey* a, PermKey* b, PermKey* ia, PermKey* ib)
 {
-	return init_params(p, 1488, 744, 124, 219, 128/8, 72957, 128/8);
+	PermKey mask = -perm_key_gt(*a, *b);
+	PermKey t = (*a ^ *b) & mask;
+	*a ^= t;
+	*b ^= t;
+	t = (*ia ^ *ib) & mask;
+	*ia ^= t;
+	*ib ^= t;
 }
 
-// Initializes a parameter set for 128-bit classical security.
-int init_params_128cl(Params* p)
+// Sorts the n keys in x, and the indices in xi along with them.
+void perm_sort_generic(PermKey* x, PermKey* xi, size_t n)
 {
-	return init_params(p, 1664, 832, 143, 219, 256/8, 92449, 256/8);
+	if (n < 2) {
+		return;
+	}
+	size_t top = 1;
+	while (top < n - top) {
+		top += top;
+	}
+	for (size_t p=top; p>0; p>>=1) {
+		for (size_t j=0; j+p<n; j++) {
+			if ((j & p) == 0) {
+				perm_minmax(&x[j], &x[j+p], &xi[j], &xi[j+p]);
+			}
+		}
+		for (size_t j=0; j+2*p<n; j++) {
+			if ((j & p) == 0) {
+				PermKey a = x[j+p];
+				PermKey ia = xi[j+p];
+				for (size_t r=top; r>p; r>>=1) {
+					if (j+r < n) {
+						perm_minmax(&a, &x[j+r], &ia, &xi[j+r]);
+					}
+				}
+				x[j+p] = a;
+				xi[j+p] = ia;
+			}
+		}
+	}
 }
 
-// Initializes a parameter set for 96-bit post-quantum security.
-int init_params_96pq(Params* p)
+#if defined(X86_SIMD_KERNELS) && defined(PERMUTATIONS_USE_64BIT)
+// The vectorized networks process the keys in windows of two vectors. For this, the keys are padded to a multiple
+// of the window size, plus one more window, with keys that are all ones. A padding key never moves in the network:
+// it always takes the upper position of a comparison and the comparison is strict, also if a key is all ones.
+// Thus the comparisons among the actual keys are exactly those of perm_sort_generic, in the same order.
+// Comparisons of x[j] with x[j+p] are vectorized over consecutive j if p is at least the vector width,
+// and over the j with bit p clear within one window otherwise.
+
+// AVX2: four keys per vector. There is no unsigned 64-bit comparison, thus the sign bits are flipped first.
+__attribute__((target("avx2")))
+static inline void perm_minmax_avx2(__m256i* a, __m256i* b, __m256i* ia, __m256i* ib)
 {
-	return init_params(p, 2222, 1111, 185, 329, 192/8, 156483, 192/8);
+	const __m256i sign = _mm256_set1_epi64x((long long) 0x8000000000000000ULL);
+	__m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(*a, sign), _mm256_xor_si256(*b, sign));
+	__m256i t = _mm256_and_si256(_mm256_xor_si256(*a, *b), gt);
+	*a = _mm256_xor_si256(*a, t);
+	*b = _mm256_xor_si256(*b, t);
+	t = _mm256_and_si256(_mm256_xor_si256(*ia, *ib), gt);
+	*ia = _mm256_xor_si256(*ia, t);
+	*ib = _mm256_xor_si256(*ib, t);
 }
 
-// Initializes a parameter set for 192-bit classical security.
-int init_params_192cl(Params* p)
+// Splits the window (lo, hi) of eight keys into the keys at positions with bit p clear (*a) and set (*b), p < 4.
+__attribute__((target("avx2")))
+static inline void perm_split_avx2(__m256i lo, __m256i hi, size_t p, __m256i* a, __m256i* b)
 {
-	return init_params(p, 2500, 1250, 215, 329, 384/8, 200943, 384/8);
+	if (p == 1) {
+		*a = _mm256_unpacklo_epi64(lo, hi);
+		*b = _mm256_unpackhi_epi64(lo, hi);
+	} else { // p == 2
+		*a = _mm256_permute2x128_si256(lo, hi, 0x20);
+		*b = _mm256_permute2x128_si256(lo, hi, 0x31);
+	}
 }
 
-// Initializes a parameter set for 128-bit post-quantum security.
-int init_params_128pq(Params* p)
+// Inverse of perm_split_avx2.
+__attribute__((target("avx2")))
+static inline void perm_join_avx2(__m256i a, __m256i b, size_t p, __m256i* lo, __m256i* hi)
 {
-	return init_params(p, 2966, 1483, 247, 438, 256/8, 270314, 256/8);
+	if (p == 1) {
+		*lo = _mm256_unpacklo_epi64(a, b);
+		*hi = _mm256_unpackhi_epi64(a, b);
+	} else { // p == 2
+		*lo = _mm256_permute2x128_si256(a, b, 0x20);
+		*hi = _mm256_permute2x128_si256(a, b, 0x31);
+	}
 }
 
-// Initializes a parameter set for 256-bit classical security.
-int init_params_256cl(Params* p)
+// Loads the window of eight keys at x, split by bit p.
+__attribute__((target("avx2")))
+static inline void perm_load_split_avx2(const PermKey* x, size_t p, __m256i* a, __m256i* b)
 {
-	return init_params(p, 3326, 1663, 286, 438, 512/8, 348109, 512/8);
+	perm_split_avx2(_mm256_loadu_si256((const __m256i*) x), _mm256_loadu_si256((const __m256i*) (x+4)), p, a, b);
 }
 
-/* -------------------------------------------------- */
-
-// Generates a key pair.
-int generate_keypair(const Params* p, unsigned char* sk, unsigned char* pk)
+// Stores the window of eight keys at x, joined by bit p.
+__attribute__((target("avx2")))
+static inline void perm_join_store_avx2(PermKey* x, size_t p, __m256i a, __m256i b)
 {
-	// detect failures, e.g. generating randomness or evaluating SHAKE
-	bool fail = false;
-
-	// generate (the seed for) the private key
-	if (get_randomness(sk, p->seedSkByteLen) != 0) {
-		// something went wrong
-		fail = true;
-	}
+	__m256i lo, hi;
+	perm_join_avx2(a, b, p, &lo, &hi);
+	_mm256_storeu_si256((__m256i*) x, lo);
+	_mm256_storeu_si256((__m256i*) (x+4), hi);
+}
 
-	// set up a Keccak hash instance
-	Keccak_HashInstance hashInstance;
-	if (Keccak_HashInitialize_SHAKE256(&hashInstance) != SUCCESS) {
-		// the initialization was unsuccessful
-		return -1;
-	}
-	if (Keccak_HashUpdate(&hashInstance, sk, p->seedSkByteLen * 8) != SUCCESS) {
-		// the updating was unsuccessful
-		return -1;
+__attribute__((target("avx2")))
+void perm_sort_avx2(PermKey* x, PermKey* xi, size_t n)
+{
+	if (n < 2) {
+		return;
 	}
-	if (Keccak_HashFinal(&hashInstance, NULL) != SUCCESS) {
-		// the finalization was unsuccessful
-		return -1;
+	size_t top = 1;
+	while (top < n - top) {
+		top += top;
 	}
+	size_t len = (n + 7) & ~((size_t)7); // whole windows, the keys up to len+8 are read and written
+	for (size_t p=top; p>0; p>>=1) {
+		if (p >= 4) {
+			for (size_t i=0; i+p<len; i+=2*p) {
+				for (size_t j=i; (j<i+p) && (j+p<len); j+=4) {
+					__m256i a = _mm256_loadu_si256((const __m256i*) (x+j));
+					__m256i b = _mm256_loadu_si256((const __m256i*) (x+j+p));
+					__m256i ia = _mm256_loadu_si256((const __m256i*) (xi+j));
+					__m256i ib = _mm256_loadu_si256((const __m256i*) (xi+j+p));
+					perm_minmax_avx2(&a, &b, &ia, &ib);
+					_mm256_storeu_si256((__m256i*) (x+j), a);
+					_mm256_storeu_si256((__m256i*) (x+j+p), b);
+					_mm256_storeu_si256((__m256i*) (xi+j), ia);
+					_mm256_storeu_si256((__m256i*) (xi+j+p), ib);
+				}
+			}
+			for (size_t i=0; i+2*p<len; i+=2*p) {
+				for (size_t j=i; (j<i+p) && (j+2*p<len); j+=4) {
+					__m256i a = _mm256_loadu_si256((const __m256i*) (x+j+p));
+					__m256i ia = _mm256_loadu_si256((const __m256i*) (xi+j+p));
+					for (size_t r=top; r>p; r>>=1) {
+						if (j+r >= len) {
+							continue;
+						}
+						__m256i b = _mm256_loadu_si256((const __m256i*) (x+j+r));
+						__m256i ib = _mm256_loadu_si256((const __m256i*) (xi+j+r));
+						perm_minmax_avx2(&a, &b, &ia, &ib);
+						_mm256_storeu_si256((__m256i*) (x+j+r), b);
+						_mm256_storeu_si256((__m256i*) (xi+j+r), ib);
+					}
+					_mm256_storeu_si256((__m256i*) (x+j+p), a);
+					_mm256_storeu_si256((__m256i*) (xi+j+p), ia);
+				}
+			}
+		} else {
+			__m256i a, b, ia, ib;
+			for (size_t j=0; j+p<len; j+=8) {
+				perm_load_split_avx2(x+j, p, &a, &b);
+				perm_load_split_avx2(xi+j, p, &ia, &ib);
+				perm_minmax_avx2(&a, &b, &ia, &ib);
+				perm_join_store_avx2(x+j, p, a, b);
+				perm_join_store_avx2(xi+j, p, ia, ib);
+			}
+			for (size_t j=0; j+2*p<len; j+=8) {
+				// the keys at positions with bit p set run through the comparisons, those with bit p clear are the partners
+				__m256i c, ic;
+				perm_load_split_avx2(x+j, p, &c, &a);
+				perm_load_split_avx2(xi+j, p, &ic, &ia);
+				for (size_t r=top; r>p; r>>=1) {
+					if (j+r >= len) {
+						continue;
+					}
+					perm_load_split_avx2(x+j+r, p, &b, &c);
+					perm_load_split_avx2(xi+j+r, p, &ib, &ic);
+					perm_minmax_avx2(&a, &b, &ia, &ib);
+					perm_join_store_avx2(x+j+r, p, b, c);
+					perm_join_store_avx2(xi+j+r, p, ib, ic);
+				}
+				// the partners within the window may have changed
+				perm_load_split_avx2(x+j, p, &c, &b);
+				perm_load_split_avx2(xi+j, p, &ic, &ib);
+				perm_join_store_avx2(x+j, p, c, a);
+				perm_join_store_avx2(xi+j, p, ic, ia);
+			}
+		}
+	}
+}
+
+// AVX-512: eight keys per vector.
+__attribute__((target("avx512f")))
+static inline void perm_minmax_avx512(__m512i* a, __m512i* b, __m512i* ia, __m512i* ib)
+{
+	__mmask8 gt = _mm512_cmpgt_epu64_mask(*a, *b);
+	__m512i min = _mm512_mask_blend_epi64(gt, *a, *b);
+	__m512i max = _mm512_mask_blend_epi64(gt, *b, *a);
+	__m512i imin = _mm512_mask_blend_epi64(gt, *ia, *ib);
+	__m512i imax = _mm512_mask_blend_epi64(gt, *ib, *ia);
+	*a = min;
+	*b = max;
+	*ia = imin;
+	*ib = imax;
+}
+
+// Lane indices for splitting a window of 16 keys by bit p, for p = 1, 2, 4:
+// the positions with bit p clear, followed by the positions with bit p set.
+const uint64_t perm_split_avx512_idx[3][16] = {
+	{ 0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15 },
+	{ 0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15 },
+	{ 0, 1, 2, 3, 8, 9, 10, 11, 4, 5, 6, 7, 12, 13, 14, 15 }
+};
+// The inverse, for joining.
+const uint64_t perm_join_avx512_idx[3][16] = {
+	{ 0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15 },
+	{ 0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15 },
+	{ 0, 1, 2, 3, 8, 9, 10, 11, 4, 5, 6, 7, 12, 13, 14, 15 }
+};
+
+// Loads the window of 16 keys at x, split by bit p, given the split indices.
+__attribute__((target("avx512f")))
+static inline void perm_load_split_avx512(const PermKey* x, __m512i idxA, __m512i idxB, __m512i* a, __m512i* b)
+{
+	__m512i lo = _mm512_loadu_si512(x);
+	__m512i hi = _mm512_loadu_si512(x+8);
+	*a = _mm512_permutex2var_epi64(lo, idxA, hi);
+	*b = _mm512_permutex2var_epi64(lo, idxB, hi);
+}
+
+// Stores the window of 16 keys at x, joined by bit p, given the join indices.
+__attribute__((target("avx512f")))
+static inline void perm_join_store_avx512(PermKey* x, __m512i idxLo, __m512i idxHi, __m512i a, __m512i b)
+{
+	_mm512_storeu_si512(x, _mm512_permutex2var_epi64(a, idxLo, b));
+	_mm512_storeu_si512(x+8, _mm512_permutex2var_epi64(a, idxHi, b));
+}
+
+__attribute__((target("avx512f")))
+void perm_sort_avx512(PermKey* x, PermKey* xi, size_t n)
+{
+	if (n < 2) {
+		return;
+	}
+	size_t top = 1;
+	while (top < n - top) {
+		top += top;
+	}
+	size_t len = (n + 15) & ~((size_t)15); // whole windows, the keys up to len+16 are read and written
+	for (size_t p=top; p>0; p>>=1) {
+		if (p >= 8) {
+			for (size_t i=0; i+p<len; i+=2*p) {
+				for (size_t j=i; (j<i+p) && (j+p<len); j+=8) {
+					__m512i a = _mm512_loadu_si512(x+j);
+					__m512i b = _mm512_loadu_si512(x+j+p);
+					__m512i ia = _mm512_loadu_si512(xi+j);
+					__m512i ib = _mm512_loadu_si512(xi+j+p);
+					perm_minmax_avx512(&a, &b, &ia, &ib);
+					_mm512_storeu_si512(x+j, a);
+					_mm512_storeu_si512(x+j+p, b);
+					_mm512_storeu_si512(xi+j, ia);
+					_mm512_storeu_si512(xi+j+p, ib);
+				}
+			}
+			for (size_t i=0; i+2*p<len; i+=2*p) {
+				for (size_t j=i; (j<i+p) && (j+2*p<len); j+=8) {
+					__m512i a = _mm512_loadu_si512(x+j+p);
+					__m512i ia = _mm512_loadu_si512(xi+j+p);
+					for (size_t r=top; r>p; r>>=1) {
+						if (j+r >= len) {
+							continue;
+						}
+						__m512i b = _mm512_loadu_si512(x+j+r);
+						__m512i ib = _mm512_loadu_si512(xi+j+r);
+						perm_minmax_avx512(&a, &b, &ia, &ib);
+						_mm512_storeu_si512(x+j+r, b);
+						_mm512_storeu_si512(xi+j+r, ib);
+					}
+					_mm512_storeu_si512(x+j+p, a);
+					_mm512_storeu_si512(xi+j+p, ia);
+				}
+			}
+		} else {
+			size_t k = (p == 1) ? 0 : ((p == 2) ? 1 : 2);
+			__m512i idxA = _mm512_loadu_si512(perm_split_avx512_idx[k]);
+			__m512i idxB = _mm512_loadu_si512(perm_split_avx512_idx[k] + 8);
+			__m512i idxLo = _mm512_loadu_si512(perm_join_avx512_idx[k]);
+			__m512i idxHi = _mm512_loadu_si512(perm_join_avx512_idx[k] + 8);
+			__m512i a, b, c, ia, ib, ic;
+			for (size_t j=0; j+p<len; j+=16) {
+				perm_load_split_avx512(x+j, idxA, idxB, &a, &b);
+				perm_load_split_avx512(xi+j, idxA, idxB, &ia, &ib);
+				perm_minmax_avx512(&a, &b, &ia, &ib);
+				perm_join_store_avx512(x+j, idxLo, idxHi, a, b);
+				perm_join_store_avx512(xi+j, idxLo, idxHi, ia, ib);
+			}
+			for (size_t j=0; j+2*p<len; j+=16) {
+				// the keys at positions with bit p set run through the comparisons, those with bit p clear are the partners
+				perm_load_split_avx512(x+j, idxA, idxB, &c, &a);
+				perm_load_split_avx512(xi+j, idxA, idxB, &ic, &ia);
+				for (size_t r=top; r>p; r>>=1) {
+					if (j+r >= len) {
+						continue;
+					}
+					perm_load_split_avx512(x+j+r, idxA, idxB, &b, &c);
+					perm_load_split_avx512(xi+j+r, idxA, idxB, &ib, &ic);
+					perm_minmax_avx512(&a, &b, &ia, &ib);
+					perm_join_store_avx512(x+j+r, idxLo, idxHi, b, c);
+					perm_join_store_avx512(xi+j+r, idxLo, idxHi, ib, ic);
+				}
+				// the partners within the window may have changed
+				perm_load_split_avx512(x+j, idxA, idxB, &c, &b);
+				perm_load_split_avx512(xi+j, idxA, idxB, &ic, &ib);
+				perm_join_store_avx512(x+j, idxLo, idxHi, c, a);
+				perm_join_store_avx512(xi+j, idxLo, idxHi, ic, ia);
+			}
+		}
+	}
+}
+#endif // X86_SIMD_KERNELS && PERMUTATIONS_USE_64BIT
+
+// The number of keys allocated for a permutation of n bits, including the padding for the vectorized networks.
+static inline size_t perm_keys_len(size_t n)
+{
+	return ((n + 15) & ~((size_t)15)) + 16;
+}
+
+// The sorting network used, selected at runtime (see select_kernels).
+// It sorts the first n keys, the keys beyond (up to perm_keys_len) must be all ones.
+void (*perm_sort_impl)(PermKey* x, PermKey* xi, size_t n) = perm_sort_generic;
+
+// Spreads the bits of b to the lowest bits of the bytes of the result.
+static inline uint64_t perm_spread_bits(unsigned char b)
+{
+	return (((uint64_t)(b & 0x7F) * 0x0002040810204081ULL) & 0x0101010101010101ULL) | ((uint64_t)(b >> 7) << 56);
+}
+
+// Collects the lowest bits of the bytes of x, inverse of perm_spread_bits.
+static inline unsigned char perm_collect_bits(uint64_t x)
+{
+	return (unsigned char) (((x & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56);
+}
+
+// Sorts the keys, and stores in perm->index where each of the sorted keys came from.
+// The count <= PERM_MAX_WORDS vectors words are permuted along with the keys, the result for words[v] is written to res[v]:
+// bit v of the top bits of each original position is bit i of words[v], thus sorting permutes all of them in constant time.
+// The words and results have an assumed length of p->n bits, the bits beyond are copied from the words to the results
+// no result may overlap with any word
+// returns true in case of a collision (ignoring the last bit), false otherwise
+bool perm_sort(Permutation* perm, size_t count, const unsigned char* const* words, unsigned char* const* res)
+{
+	size_t n = perm->n;
+	PermKey* keys = perm->keys;
+	PermKey* keyIndex = perm->keyIndex;
+
+	// the words are bitsliced into bytes, 8 positions at a time
+	size_t i = 0;
+	for (size_t j=0; j<(n+7)/8; j++) {
+		uint64_t s = 0;
+		for (size_t v=0; v<count; v++) {
+			s |= perm_spread_bits(words[v][j]) << v;
+		}
+		for (size_t k=0; (k<8) && (i<n); k++, i++) {
+			keyIndex[i] = i | ((PermKey) ((s >> (8*k)) & 0xFF) << PERM_WORDS_SHIFT);
+		}
+	}
+	for (size_t i=n; i<perm_keys_len(n); i++) {
+		keys[i] = ~((PermKey) 0);
+		keyIndex[i] = i;
+	}
+	perm_sort_impl(keys, keyIndex, n);
+	for (size_t i=0; i<n; i++) {
+		perm->index[i] = (uint32_t) (keyIndex[i] & (((PermKey) 1 << PERM_WORDS_SHIFT) - 1));
+	}
+
+	// collect the permuted words
+	i = 0;
+	for (size_t j=0; j<(n+7)/8; j++) {
+		uint64_t s = 0;
+		for (size_t k=0; (k<8) && (i<n); k++, i++) {
+			s |= (uint64_t) (keyIndex[i] >> PERM_WORDS_SHIFT) << (8*k);
+		}
+		for (size_t v=0; v<count; v++) {
+			res[v][j] = perm_collect_bits(s >> v);
+		}
+	}
+	if (n%8 != 0) {
+		for (size_t v=0; v<count; v++) {
+			res[v][n/8] |= words[v][n/8] & (unsigned char) (0xFF << (n%8));
+		}
+	}
+
+	// look for neighbours that only differ in the last bit
+	PermKey collision = 0;
+	for (size_t i=1; i<n; i++) {
+		collision |= ((keys[i-1]>>1) == (keys[i]>>1));
+	}
+	return collision != 0;
+}
+
+#ifdef PERMUTATIONS_USE_BENES
+// The number of layers of the Beneš network of a permutation.
+static inline size_t perm_layers(const Permutation* perm)
+{
+	return 2*perm->logLen - 1;
+}
+#endif // PERMUTATIONS_USE_BENES
+
+// Lays out the memory of a permutation of p->n bits in the workspace.
+// The permutation lives as long as the workspace, there is nothing to release.
+void perm_init_ws(const Params* p, Permutation* perm, Workspace* ws)
+{
+	perm->n = p->n;
+	perm->index = (uint32_t*) ws_take(ws, p->n * sizeof(uint32_t));
+	perm->keys = (PermKey*) ws_take(ws, perm_keys_len(p->n) * sizeof(PermKey));
+	perm->keyIndex = (PermKey*) ws_take(ws, perm_keys_len(p->n) * sizeof(PermKey));
+#ifdef PERMUTATIONS_USE_BENES
+	// the network works on whole 64-bit words
+	perm->logLen = 6;
+	while (((size_t)1 << perm->logLen) < p->n) {
+		perm->logLen++;
+	}
+	size_t len = (size_t)1 << perm->logLen;
+	perm->control = (uint64_t*) ws_take(ws, perm_layers(perm) * (len/64) * sizeof(uint64_t));
+	perm->work = (uint32_t*) ws_take(ws, 5 * len * sizeof(uint32_t));
+	perm->vec = (uint64_t*) ws_take(ws, (len/64) * sizeof(uint64_t));
+#endif // PERMUTATIONS_USE_BENES
+}
+
+#ifdef PERMUTATIONS_USE_BENES
+// Computes the control bits of the Beneš network from perm->index, with the looping algorithm.
+// The network on 2^m bits consists of the layers with strides 1, 2, ..., 2^(m-1), ..., 2, 1.
+// Layer k swaps bits i and i+stride if bit i of its mask is set, for the i with bit i & stride clear.
+// Recursively, the first and the last layer of a network route the bits at even and odd positions
+// through the subnetworks on the even and on the odd positions.
+void perm_control_bits(Permutation* perm)
+{
+	size_t m = perm->logLen;
+	size_t len = (size_t)1 << m;
+	size_t words = len/64;
+	uint32_t* cur = perm->work;
+	uint32_t* next = cur + len;
+	uint32_t* inv = next + len;
+	uint32_t* color = inv + 2*len;
+	memset(perm->control, 0, perm_layers(perm) * words * sizeof(uint64_t));
+
+	// output i of the network is input cur[i]
+	for (size_t i=0; i<len; i++) {
+		cur[i] = (i < perm->n) ? perm->index[i] : i;
+	}
+	// at depth k, there are 2^k subnetworks of size 2^(m-k), on the positions that are equal modulo 2^k
+	for (size_t k=0; k+1<m; k++) {
+		size_t size = len >> k;
+		size_t subs = (size_t)1 << k;
+		uint64_t* first = perm->control + k*words;
+		uint64_t* last = perm->control + (2*m-2-k)*words;
+		for (size_t low=0; low<subs; low++) {
+			const uint32_t* q = cur + low*size;
+			for (size_t j=0; j<size; j++) {
+				inv[q[j]] = j;
+			}
+			// the output paired with the partner of the input of output j
+			uint32_t* partner = inv + len;
+			for (size_t j=0; j<size; j++) {
+				partner[j] = inv[q[j]^1]^1;
+				color[j] = 2;
+			}
+			// color each output with the subnetwork it comes from, such that the two inputs of a pair,
+			// and the two outputs of a pair, come from different subnetworks
+			for (size_t start=0; start<size; start+=2) {
+				size_t j = start;
+				while (color[j] == 2) {
+					color[j] = 0;
+					color[j^1] = 1;
+					j = partner[j];
+				}
+			}
+			for (size_t u=0; u<size/2; u++) {
+				size_t pos = low | ((2*u) << k);
+				first[pos/64] |= (uint64_t) color[inv[2*u]] << (pos%64);
+				last[pos/64] |= (uint64_t) color[2*u] << (pos%64);
+			}
+			for (size_t j=0; j<size; j++) {
+				next[(low + color[j]*subs)*(size/2) + j/2] = q[j]/2;
+			}
+		}
+		uint32_t* t = cur;
+		cur = next;
+		next = t;
+	}
+	// the middle layer consists of networks of size 2
+	uint64_t* middle = perm->control + (m-1)*words;
+	for (size_t low=0; low<len/2; low++) {
+		middle[low/64] |= (uint64_t) cur[2*low] << (low%64);
+	}
+}
+#endif // PERMUTATIONS_USE_BENES
+
+// Generates the permutation determined by seedPerm, without allocating memory.
+// The permutation sorts a list of p->n keys that are expanded from the seed.
+// In the (unlikely) case of a collision in the sorting, the next p->n keys of the expansion are used.
+// The count <= PERM_MAX_WORDS vectors words are permuted while sorting, in constant time, the result for words[v] is written to res[v].
+// Only without such vectors (count == 0), the permutation is meant to be applied later on (see perm_apply), which is not
+// constant-time: it depends on the permutation through the memory accesses, hence it must only be used for public permutations.
+// returns 0 if successful and -1 otherwise
+int perm_generate(const Params* p, const unsigned char* seedPerm, Permutation* perm, size_t count, const unsigned char* const* words, unsigned char* const* res)
+{
+	// detect failures evaluating SHAKE
+	bool fail = false;
+
+	// the keys are squeezed p->n at a time, thus the expansion is not recomputed after a collision
+	Keccak_HashInstance hashInstance;
+	if (Keccak_HashInitialize_SHAKE256(&hashInstance) != SUCCESS) { fail = true; };
+	if (Keccak_HashUpdate(&hashInstance, seedPerm, p->seedPermByteLen * 8) != SUCCESS) { fail = true; };
+	if (Keccak_HashFinal(&hashInstance, NULL) != SUCCESS) { fail = true; };
+
+	while (true) {
+		if (Keccak_HashSqueeze(&hashInstance, (unsigned char*) perm->keys, p->n * sizeof(PermKey) * 8) != SUCCESS) { fail = true; };
+		// sort numbers
+		bool collision = perm_sort(perm, count, words, res);
+		if (!collision || fail) {
+			break;
+		}
+		// we need to start over and try again
+	}
+	zeroize(&hashInstance, sizeof(Keccak_HashInstance));
+#ifdef PERMUTATIONS_USE_BENES
+	if (count == 0) {
+		perm_control_bits(perm);
+	}
+#endif
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// Generates the permutations determined by seedPerm[0],...,seedPerm[count-1], count <= SHAKE_MAX_LANES, without allocating memory.
+// The keys of all permutations are expanded at once (see shake256_many), the result is the same as of perm_generate.
+// Permutation k permutes the wordCount vectors words[k*wordCount],... while sorting, the results are written to res[k*wordCount],...
+// returns 0 if successful and -1 otherwise
+int perm_generate_many(const Params* p, const unsigned char* const* seedPerm, size_t count, Permutation* perms,
+	size_t wordCount, const unsigned char* const* words, unsigned char* const* res)
+{
+	// detect failures evaluating SHAKE
+	bool fail = false;
+
+	unsigned char* keys[SHAKE_MAX_LANES] = { NULL };
+	for (size_t k=0; k<count; k++) {
+		keys[k] = (unsigned char*) perms[k].keys;
+	}
+	if (shake256_many(keys, p->n * sizeof(PermKey), seedPerm, p->seedPermByteLen, count) != 0) { fail = true; };
+	for (size_t k=0; (k<count) && !fail; k++) {
+		const unsigned char* const* wordsK = (wordCount == 0) ? NULL : words + k*wordCount;
+		unsigned char* const* resK = (wordCount == 0) ? NULL : res + k*wordCount;
+		bool collision = perm_sort(&perms[k], wordCount, wordsK, resK);
+		if (collision) {
+			// the (unlikely) case of a collision is left to perm_generate, which expands the keys further
+			if (perm_generate(p, seedPerm[k], &perms[k], wordCount, wordsK, resK) != 0) { fail = true; };
+		} else {
+#ifdef PERMUTATIONS_USE_BENES
+			if (wordCount == 0) {
+				perm_control_bits(&perms[k]);
+			}
+#endif
+		}
+	}
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// Applies a permutation to a word on bit-level by gathering the bits at perm->index, the result is written to res.
+// word and res have an assumed length of p->n bits, the bits beyond are copied from word to res
+// word and res must not overlap
+void perm_apply_index(const Permutation* perm, const unsigned char* word, unsigned char* res)
+{
+	size_t n = perm->n;
+	const uint32_t* index = perm->index;
+	size_t i = 0;
+	for (size_t j=0; j<(n+7)/8; j++) {
+		unsigned char b = 0;
+		for (size_t k=0; (k<8) && (i<n); k++, i++) {
+			b |= ((word[index[i]/8] >> (index[i]%8)) & 1) << k;
+		}
+		res[j] = b;
+	}
+	if (n%8 != 0) {
+		res[n/8] |= word[n/8] & (unsigned char) (0xFF << (n%8));
+	}
+}
+
+#ifdef PERMUTATIONS_USE_BENES
+// Applies a permutation to a word on bit-level as a Beneš network, the result is written to res.
+// word and res have an assumed length of p->n bits, the bits beyond are copied from word to res
+// the control bits must have been computed (see perm_control_bits)
+void perm_apply_benes(const Permutation* perm, const unsigned char* word, unsigned char* res)
+{
+	// run the packed word through the layers of the network
+	size_t m = perm->logLen;
+	size_t words = ((size_t)1 << m)/64;
+	size_t bytes = (perm->n + 7)/8;
+	uint64_t* v = perm->vec;
+
+	memset(v, 0, words * sizeof(uint64_t));
+	for (size_t i=0; i<bytes; i++) {
+		v[i/8] |= (uint64_t) word[i] << (8*(i%8));
+	}
+	for (size_t k=0; k<perm_layers(perm); k++) {
+		const uint64_t* mask = perm->control + k*words;
+		size_t stride = (size_t)1 << ((k < m) ? k : 2*m-2-k);
+		if (stride < 64) {
+			for (size_t w=0; w<words; w++) {
+				uint64_t t = ((v[w] >> stride) ^ v[w]) & mask[w];
+				v[w] ^= t ^ (t << stride);
+			}
+		} else {
+			size_t s = stride/64;
+			for (size_t w=0; w<words; w++) {
+				if ((w & s) == 0) {
+					uint64_t t = (v[w] ^ v[w+s]) & mask[w];
+					v[w] ^= t;
+					v[w+s] ^= t;
+				}
+			}
+		}
+	}
+	for (size_t i=0; i<bytes; i++) {
+		res[i] = (unsigned char) (v[i/8] >> (8*(i%8)));
+	}
+}
+#endif // PERMUTATIONS_USE_BENES
+
+// Applies a permutation to a word on bit-level, the result is written to res.
+// word and res have an assumed length of p->n bits, the bits beyond are copied from word to res
+// word and res must not overlap
+// The memory accesses of the gather depend on the permutation, and the control bits of the Beneš network are not computed
+// in constant time, thus it must only be applied to public permutations (see perm_generate).
+void perm_apply(const Permutation* perm, const unsigned char* word, unsigned char* res)
+{
+#ifdef PERMUTATIONS_USE_BENES
+	perm_apply_benes(perm, word, res);
+#else
+	perm_apply_index(perm, word, res);
+#endif // PERMUTATIONS_USE_BENES
+}
+
+#ifdef PERMUTATIONS_USE_BENES
+// Generates count permutations from random seeds and applies each of them to a random word,
+// as a Beneš network and by index. *mismatches is set to the number of permutations for which the results differ.
+// returns 0 if successful and -1 otherwise
+int perm_compare_benes(const Params* p, size_t count, size_t* mismatches)
+{
+	// detect failures, e.g. generating randomness or evaluating SHAKE
+	bool fail = false;
+
+	// the permutation, its seed, the word and both results, in one block
+	Permutation perm;
+	Workspace ws = { NULL, 0 };
+	perm_init_ws(p, &perm, &ws);
+	ws_take(&ws, p->seedPermByteLen);
+	ws_take_arrays(&ws, 3, p->n_in_bytes);
+	ws.base = (unsigned char*) ws_alloc(ws.used);
+	if (ws.base == NULL) {
+		return -1;
+	}
+	ws.used = 0;
+	perm_init_ws(p, &perm, &ws);
+	unsigned char* seedPerm = (unsigned char*) ws_take(&ws, p->seedPermByteLen);
+	unsigned char** words = ws_take_arrays(&ws, 3, p->n_in_bytes);
+	unsigned char* word = words[0];
+	unsigned char* resBenes = words[1];
+	unsigned char* resIndex = words[2];
+
+	*mismatches = 0;
+	for (size_t c=0; (c<count) && !fail; c++) {
+		if (get_randomness(seedPerm, p->seedPermByteLen) != 0) { fail = true; };
+		if (get_randomness(word, p->n_in_bytes) != 0) { fail = true; };
+		if (perm_generate(p, seedPerm, &perm, 0, NULL, NULL) != 0) { fail = true; };
+		perm_apply_benes(&perm, word, resBenes);
+		perm_apply_index(&perm, word, resIndex);
+		if (memcmp(resBenes, resIndex, p->n_in_bytes) != 0) {
+			(*mismatches)++;
+		}
+	}
+	free(ws.base);
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+#endif // PERMUTATIONS_USE_BENES
+
+/* -------------------------------------------------- */
+/* Memory for secret data */
+
+// memset, called through a volatile pointer such that the compiler cannot remove the call
+void* (*const volatile memset_volatile)(void*, int, size_t) = memset;
+
+// Overwrites len bytes at buf with zeros, also if buf is not read afterwards.
+void zeroize(void* buf, size_t len)
+{
+	memset_volatile(buf, 0, len);
+}
+
+// Allocates len bytes, aligned to a cache line, and tries to lock them into RAM (such that they are never swapped out).
+// *locked is set to false if the memory could not be locked, which does not count as a failure.
+// returns a pointer to the zero-initialized memory, or NULL if the allocation failed
+void* alloc_locked(size_t len, bool* locked)
+{
+	void* buf;
+	if (posix_memalign(&buf, 64, len) != 0) {
+		return NULL;
+	}
+	memset(buf, 0, len);
+	if (mlock(buf, len) != 0) {
+		*locked = false;
+	}
+	return buf;
+}
+
+// Zeroizes, unlocks and frees len bytes allocated by alloc_locked.
+void free_locked(void* buf, size_t len)
+{
+	if (buf == NULL) {
+		return;
+	}
+	zeroize(buf, len);
+	munlock(buf, len);
+	free(buf);
+}
+
+/* -------------------------------------------------- */
+/* The parity-check matrix */
+
+// The alignment of the rows of H (in bytes), one cache line.
+#define H_ROW_ALIGNMENT 64
+
+// Returns a pointer to the i-th row of H.
+static inline const uint64_t* H_row(const ParityCheckMatrix* H, size_t i)
+{
+	return H->data + i*H->rowWordLen;
+}
+
+// Returns the size of the memory block holding H (in bytes).
+static inline size_t H_byte_len(const ParityCheckMatrix* H)
+{
+	return H->rows * H->rowWordLen * sizeof(uint64_t);
+}
+
+// Expands seedH to the parity-check matrix H.
+// The rows of H are squeezed one after another from SHAKE-256, which results in the same matrix as one large squeeze.
+// H needs to be released with free_H afterwards, also in case of a failure.
+// returns 0 if successful and -1 otherwise
+int expand_H(const Params* p, const unsigned char* seedH, ParityCheckMatrix* H)
+{
+	H->rows = p->r;
+	H->wordLen = (p->n_in_bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	// pad every row to a multiple of the alignment
+	H->rowWordLen = ((p->n_in_bytes + H_ROW_ALIGNMENT - 1) / H_ROW_ALIGNMENT) * (H_ROW_ALIGNMENT / sizeof(uint64_t));
+
+	// allocate one block for the complete matrix
+	if (posix_memalign((void**) &H->data, H_ROW_ALIGNMENT, H_byte_len(H)) != 0) {
+		H->data = NULL;
+		return -1;
+	}
+	memset(H->data, 0, H_byte_len(H));
+
+	// set up a Keccak hash instance and feed the seed
+	Keccak_HashInstance hashInstance;
+	if (Keccak_HashInitialize_SHAKE256(&hashInstance) != SUCCESS) {
+		return -1;
+	}
+	if (Keccak_HashUpdate(&hashInstance, seedH, p->seedHByteLen * 8) != SUCCESS) {
+		return -1;
+	}
+	if (Keccak_HashFinal(&hashInstance, NULL) != SUCCESS) {
+		return -1;
+	}
+
+	// squeeze the rows
+	for (size_t i=0; i<H->rows; i++) {
+		unsigned char* row = (unsigned char*) (H->data + i*H->rowWordLen);
+		if (Keccak_HashSqueeze(&hashInstance, row, p->n_in_bytes * 8) != SUCCESS) {
+			return -1;
+		}
+		// make sure the invalid bits are zero
+		row[p->n_in_bytes-1] &= (unsigned char) ((1<<(((p->n+7)%8)+1))-1); // mask the last block
+	}
+
+	// successful execution
+	return 0;
+}
+
+// Releases the memory held by H.
+void free_H(ParityCheckMatrix* H)
+{
+	free(H->data);
+	H->data = NULL;
+}
+
+/* -------------------------------------------------- */
+/* Arithmetic in F_2 */
+
+// A kernel computing the product H*x, writing one bit per row of H to res.
+// xw holds x, zero-padded to H->rowWordLen words, and res must be zero initially.
+typedef void (*mult_H_kernel)(const ParityCheckMatrix* H, const uint64_t* xw, unsigned char* res);
+
+// Portable kernel, working on 64-bit words.
+void mult_H_generic64(const ParityCheckMatrix* H, const uint64_t* xw, unsigned char* res)
+{
+	for (size_t i=0; i<H->rows; i++) { // every iteration computes one bit of the result
+		// perform AND and compute parity
+		const uint64_t* row = H_row(H, i);
+		uint64_t acc = 0;
+		for (size_t j=0; j<H->wordLen; j++) {
+			acc ^= row[j] & xw[j];
+		}
+		res[i/8] |= ((unsigned char) __builtin_parityll(acc))<<(i%8); // insert bit into the result
+	}
+}
+
+#ifdef X86_SIMD_KERNELS
+// AVX2 kernel, working on 256-bit vectors.
+__attribute__((target("avx2,popcnt")))
+void mult_H_avx2(const ParityCheckMatrix* H, const uint64_t* xw, unsigned char* res)
+{
+	for (size_t i=0; i<H->rows; i++) {
+		const uint64_t* row = H_row(H, i);
+		__m256i acc = _mm256_setzero_si256();
+		for (size_t j=0; j<H->rowWordLen; j+=4) {
+			acc = _mm256_xor_si256(acc, _mm256_and_si256(_mm256_load_si256((const __m256i*) (row+j)), _mm256_loadu_si256((const __m256i*) (xw+j))));
+		}
+		// fold the vector to one word and compute the parity
+		uint64_t w = _mm256_extract_epi64(acc, 0) ^ _mm256_extract_epi64(acc, 1) ^ _mm256_extract_epi64(acc, 2) ^ _mm256_extract_epi64(acc, 3);
+		res[i/8] |= ((unsigned char) __builtin_parityll(w))<<(i%8);
+	}
+}
+
+// AVX-512 kernel, working on 512-bit vectors.
+// The AND and the accumulation are done by one ternary logic instruction, the parity is taken from the lane-wise popcount.
+__attribute__((target("avx512f,avx512vpopcntdq")))
+void mult_H_avx512(const ParityCheckMatrix* H, const uint64_t* xw, unsigned char* res)
+{
+	for (size_t i=0; i<H->rows; i++) {
+		const uint64_t* row = H_row(H, i);
+		__m512i acc = _mm512_setzero_si512();
+		for (size_t j=0; j<H->rowWordLen; j+=8) {
+			// acc = acc ^ (row & x)
+			acc = _mm512_ternarylogic_epi64(acc, _mm512_load_si512(row+j), _mm512_loadu_si512(xw+j), 0x78);
+		}
+		uint64_t wt = (uint64_t) _mm512_reduce_add_epi64(_mm512_popcnt_epi64(acc));
+		res[i/8] |= ((unsigned char) (wt & 1))<<(i%8);
+	}
+}
+#endif // X86_SIMD_KERNELS
+
+// The kernel used by mult_H, see select_kernels.
+mult_H_kernel mult_H_impl = mult_H_generic64;
+
+// Performs the multiplication H*x on bit-level (in F_2) and write the result to res.
+// note: in res there must be space for at least p->r_in_bytes bytes
+void mult_H(const Params* p, const ParityCheckMatrix* H, const unsigned char* x, unsigned char* res)
+{
+	// copy x to a zero-padded buffer of whole words
+	uint64_t xw[H->rowWordLen] __attribute__((aligned(H_ROW_ALIGNMENT)));
+	memset(xw, 0, sizeof(xw));
+	memcpy(xw, x, p->n_in_bytes);
+	// set res to zero
+	memset(res, 0, p->r_in_bytes);
+	// compute matrix-vector multiplication H*x = res
+	mult_H_impl(H, xw, res);
+}
+
+// Number of vectors multiplied with H in one pass of mult_H_batch, one per bit of a word.
+#define MULT_H_BATCH_SIZE 64
+// Minimal number of vectors for which a pass of mult_H_batch is faster than multiplying them one by one.
+#define MULT_H_BATCH_MIN 16
+
+// The scratch memory of mult_H_batch.
+typedef struct {
+	// the bit-sliced vectors, padded to whole 64x64 blocks
+	uint64_t* xt;
+	// the bit-sliced results, padded to whole 64x64 blocks
+	uint64_t* rest;
+	// one table for each byte of a word
+	uint64_t* tables;
+} MultHScratch;
+
+// Lays out the scratch memory of mult_H_batch in the workspace.
+void mult_H_scratch_init(const Params* p, MultHScratch* scratch, Workspace* ws)
+{
+	scratch->xt = (uint64_t*) ws_take(ws, (p->n_in_bytes + 7) / 8 * 64 * sizeof(uint64_t));
+	scratch->rest = (uint64_t*) ws_take(ws, (p->r + 63) / 64 * 64 * sizeof(uint64_t));
+	scratch->tables = (uint64_t*) ws_take(ws, 8 * 256 * sizeof(uint64_t));
+}
+
+// Reads len <= 8 bytes as a little-endian word, such that bit j of the word is bit j of the byte string.
+static inline uint64_t load_le64(const unsigned char* b, size_t len)
+{
+	uint64_t w = 0;
+	for (size_t i=0; i<len; i++) {
+		w |= ((uint64_t) b[i])<<(8*i);
+	}
+	return w;
+}
+
+// Writes the len <= 8 least significant bytes of a word in little-endian order.
+static inline void store_le64(unsigned char* b, uint64_t w, size_t len)
+{
+	for (size_t i=0; i<len; i++) {
+		b[i] = (unsigned char) (w>>(8*i));
+	}
+}
+
+// Transposes the 64x64 bit matrix a in place, where bit j of a[i] is the entry in row i and column j.
+void transpose_64x64(uint64_t* a)
+{
+	uint64_t m = 0x00000000FFFFFFFF;
+	for (size_t j=32; j!=0; j>>=1, m^=(m<<j)) {
+		// swap the upper right and the lower left j x j blocks of all 2j x 2j blocks on the diagonal
+		for (size_t k=0; k<64; k=((k|j)+1)&(~j)) {
+			uint64_t t = ((a[k]>>j) ^ a[k|j]) & m;
+			a[k] ^= t<<j;
+			a[k|j] ^= t;
+		}
+	}
+}
+
+// Performs the multiplications H*x[k] on bit-level (in F_2) for all k in {0,...,count-1} and writes the results to res[k].
+// The vectors are processed in batches of MULT_H_BATCH_SIZE, which are bit-sliced such that one word holds the same bit of all vectors.
+// Every row of H is then loaded once per batch (instead of once per vector) and applied to all vectors with the Method of Four Russians:
+// for each byte of a row, the sum of the selected bit-sliced words is looked up in a table of all 256 combinations.
+// note: in every res[k] there must be space for at least p->r_in_bytes bytes, scratch is laid out by mult_H_scratch_init
+// returns 0 if successful and -1 otherwise
+int mult_H_batch(const Params* p, const ParityCheckMatrix* H, const unsigned char* const* x, size_t count, unsigned char* const* res, const MultHScratch* scratch)
+{
+	uint64_t* xt = scratch->xt;
+	size_t resWordLen = (H->rows + 63) / 64;
+	uint64_t* rest = scratch->rest;
+	uint64_t* tables = scratch->tables;
+
+	for (size_t batch=0; batch<count; batch+=MULT_H_BATCH_SIZE) {
+		size_t batchLen = (count - batch < MULT_H_BATCH_SIZE) ? (count - batch) : MULT_H_BATCH_SIZE;
+		if (batchLen < MULT_H_BATCH_MIN) {
+			// too few vectors left to amortize the bit-slicing
+			for (size_t k=0; k<batchLen; k++) {
+				mult_H(p, H, x[batch+k], res[batch+k]);
+			}
+			continue;
+		}
+
+		// bit-slice the vectors of this batch, such that bit k of xt[j] is bit j of x[batch+k]
+		for (size_t w=0; w<H->wordLen; w++) {
+			uint64_t* block = xt + w*64;
+			size_t len = (p->n_in_bytes - w*8 < 8) ? (p->n_in_bytes - w*8) : 8; // the last word may be incomplete
+			for (size_t k=0; k<64; k++) {
+				block[k] = (k < batchLen) ? load_le64(x[batch+k] + w*8, len) : 0;
+			}
+			transpose_64x64(block);
+		}
+
+		// compute the bit-sliced products, word by word of the rows of H
+		memset(rest, 0, resWordLen * 64 * sizeof(uint64_t));
+		for (size_t w=0; w<H->wordLen; w++) {
+			// tabulate the sums of the bit-sliced vectors for each byte of this word
+			for (size_t b=0; b<8; b++) {
+				uint64_t* table = tables + b*256;
+				const uint64_t* xtb = xt + w*64 + b*8;
+				table[0] = 0;
+				for (size_t v=1; v<256; v++) {
+					table[v] = table[v & (v-1)] ^ xtb[__builtin_ctz(v)];
+				}
+			}
+			// apply to all rows
+			for (size_t i=0; i<H->rows; i++) {
+				const unsigned char* row = (const unsigned char*) (H_row(H, i) + w);
+				rest[i] ^= tables[row[0]] ^ tables[256 + row[1]] ^ tables[512 + row[2]] ^ tables[768 + row[3]]
+					^ tables[1024 + row[4]] ^ tables[1280 + row[5]] ^ tables[1536 + row[6]] ^ tables[1792 + row[7]];
+			}
+		}
+
+		// transpose back, such that bit i of rest[k] is bit i of H*x[batch+k] (per block of 64 rows)
+		for (size_t w=0; w<resWordLen; w++) {
+			uint64_t* block = rest + w*64;
+			size_t len = (p->r_in_bytes - w*8 < 8) ? (p->r_in_bytes - w*8) : 8;
+			transpose_64x64(block);
+			for (size_t k=0; k<batchLen; k++) {
+				store_le64(res[batch+k] + w*8, block[k], len);
+			}
+		}
+	}
+
+	// successful execution
+	return 0;
+}
+
+// Performs the addition x+y on bit-level (in F_2) and writes the result to res.
+// note: in res there must be space for at least p->n_in_bytes bytes
+void add_in_F2n(const Params* p, const unsigned char* x, const unsigned char* y, unsigned char* res)
+{
+	// add (wrap in F_2)
+	for (int i=0; i<p->n_in_bytes; i++) {
+		res[i] = x[i] ^ y[i];
+	}
+}
+
+// Performs the addition x+y on bit-level (in F_2) and writes the result to res.
+// note: in res there must be space for at least p->r_in_bytes bytes
+void add_in_F2r(const Params* p, const unsigned char* x, const unsigned char* y, unsigned char* res)
+{
+	// add (wrap in F_2)
+	for (int i=0; i<p->r_in_bytes; i++) {
+		res[i] = x[i] ^ y[i];
+	}
+}
+
+/* -------------------------------------------------- */
+/* Runtime selection of the kernels */
+
+// Restricts the kernels and the Keccak-p[1600] backend to the instruction set extensions up to level,
+// within the level, the fastest kernels supported by the CPU are selected.
+// returns 0 if successful and -1 if the CPU does not support level
+int set_kernels(KernelLevel level)
+{
+	bool avx2 = false;
+	bool avx512 = false;
+#ifdef X86_SIMD_KERNELS
+	__builtin_cpu_init();
+	avx2 = (level >= KERNELS_AVX2);
+	avx512 = (level >= KERNELS_AVX512);
+	if ((avx2 && !__builtin_cpu_supports("avx2")) || (avx512 && !__builtin_cpu_supports("avx512f"))) {
+		return -1;
+	}
+#else
+	if (level != KERNELS_GENERIC) {
+		return -1;
+	}
+#endif // X86_SIMD_KERNELS
+	if (KeccakP1600_select_backend(avx512 ? "avx512" : (avx2 ? "avx2" : "opt64")) != 0) {
+		return -1;
+	}
+
+	mult_H_impl = mult_H_generic64;
+	shake_lanes_impl = NULL;
+	perm_sort_impl = perm_sort_generic;
+#ifdef X86_SIMD_KERNELS
+	if (avx512 && __builtin_cpu_supports("avx512vpopcntdq")) {
+		mult_H_impl = mult_H_avx512;
+	} else if (avx2 && __builtin_cpu_supports("popcnt")) {
+		mult_H_impl = mult_H_avx2;
+	}
+	if (avx512) {
+		shake_lanes_impl = &shake_times8;
+	} else if (avx2) {
+		shake_lanes_impl = &shake_times4;
+	}
+#ifdef PERMUTATIONS_USE_64BIT
+	if (avx512) {
+		perm_sort_impl = perm_sort_avx512;
+	} else if (avx2) {
+		perm_sort_impl = perm_sort_avx2;
+	}
+#endif // PERMUTATIONS_USE_64BIT
+#endif // X86_SIMD_KERNELS
+
+#ifndef NIST_API
+	// the states of the randomness pools of all threads are laid out for the previous backend, they are reseeded on next use
+	atomic_fetch_add(&rand_backendGeneration, 1);
+#endif // NIST_API
+
+	// successful execution
+	return 0;
+}
+
+// Selects the fastest kernels supported by the CPU, this runs once when the program is loaded.
+__attribute__((constructor))
+void select_kernels()
+{
+	if (set_kernels(KERNELS_AVX512) != 0) {
+		if (set_kernels(KERNELS_AVX2) != 0) {
+			set_kernels(KERNELS_GENERIC);
+		}
+	}
+}
+
+/* -------------------------------------------------- */
+/* Parameters */
+
+// Initialize the parameter set given by *p.
+int init_params(Params* p, size_t n, size_t r, size_t w, size_t t, size_t seedByteLen, size_t sigByteLen, size_t chHashByteLen)
+{
+	// set the parameters
+	p->n = n;
+	p->n_in_bytes = (p->n+7)/8;
+	p->r = r;
+	p->r_in_bytes = (p->r+7)/8;
+	p->w = w;
+	p->t = t;
+	p->seedSkByteLen = seedByteLen;
+	p->seedHByteLen = seedByteLen;
+	p->commByteLen = seedByteLen;
+	p->seedYByteLen = seedByteLen;
+	p->seedPermByteLen = seedByteLen;
+	p->coinsCommByteLen = seedByteLen;
+	p->sigByteLen = sigByteLen;
+	p->chHashByteLen = chHashByteLen;
+	p->skByteLen = p->seedSkByteLen;
+	p->pkByteLen = p->seedHByteLen + p->r_in_bytes;
+
+	// successful execution
+	return 0;
+}
+
+// Initializes a parameter set for 64-bit post-quantum security.
+int init_params_64pq(Params* p)
+{
+	return init_params(p, 1488, 744, 124, 219, 128/8, 72957, 128/8);
+}
+
+// Initializes a parameter set for 128-bit classical security.
+int init_params_128cl(Params* p)
+{
+	return init_params(p, 1664, 832, 143, 219, 256/8, 92449, 256/8);
+}
+
+// Initializes a parameter set for 96-bit post-quantum security.
+int init_params_96pq(Params* p)
+{
+	return init_params(p, 2222, 1111, 185, 329, 192/8, 156483, 192/8);
+}
+
+// Initializes a parameter set for 192-bit classical security.
+int init_params_192cl(Params* p)
+{
+	return init_params(p, 2500, 1250, 215, 329, 384/8, 200943, 384/8);
+}
+
+// Initializes a parameter set for 128-bit post-quantum security.
+int init_params_128pq(Params* p)
+{
+	return init_params(p, 2966, 1483, 247, 438, 256/8, 270314, 256/8);
+}
+
+// Initializes a parameter set for 256-bit classical security.
+int init_params_256cl(Params* p)
+{
+	return init_params(p, 3326, 1663, 286, 438, 512/8, 348109, 512/8);
+}
+
+/* -------------------------------------------------- */
+
+// Samples a uniformly distributed vector of p->n bits and weight p->w from the output of reader, in constant time:
+// the next p->seedPermByteLen bytes seed a permutation (see perm_generate), which moves the vector 1...10...0 with p->w ones
+// through the constant-time sorting network. The amount of output read and the memory accesses do not depend on the result,
+// only a collision of the keys of the permutation (which is unlikely and independent of the result) takes longer.
+// The result differs from the one of sample_fixed_weight on the same output.
+// note: res needs to provide at least p->n_in_bytes bytes
+// returns 0 if successful and -1 otherwise
+int sample_fixed_weight_ct(const Params* p, ShakeReader* reader, unsigned char* res)
+{
+	// detect failures, e.g. evaluating SHAKE
+	bool fail = false;
+
+	// the permutation, its seed and the vector with the leading ones, in one block of secret data
+	Permutation perm;
+	Workspace ws = { NULL, 0 };
+	perm_init_ws(p, &perm, &ws);
+	ws_take(&ws, p->seedPermByteLen);
+	ws_take(&ws, p->n_in_bytes);
+	size_t len = ws.used;
+	bool locked;
+	ws.base = (unsigned char*) alloc_locked(len, &locked);
+	if (ws.base == NULL) {
+		return -1;
+	}
+	ws.used = 0;
+	perm_init_ws(p, &perm, &ws);
+	unsigned char* seedPerm = (unsigned char*) ws_take(&ws, p->seedPermByteLen);
+	unsigned char* ones = (unsigned char*) ws_take(&ws, p->n_in_bytes);
+
+	// the weight is public, the vector with the leading ones does not depend on the secret
+	for (size_t i=0; i<p->w; i++) {
+		ones[i/8] |= (unsigned char) (1 << (i%8));
+	}
+	if (shake_reader_bytes(reader, seedPerm, p->seedPermByteLen) != 0) { fail = true; };
+	const unsigned char* words[1] = { ones };
+	unsigned char* results[1] = { res };
+	if (!fail && (perm_generate(p, seedPerm, &perm, 1, words, results) != 0)) { fail = true; };
+	free_locked(ws.base, len);
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// Expands the secret seed sk to the seed of H and the low-weight secret priv.
+// note: in seedH there must be space for at least p->seedHByteLen bytes, in priv for at least p->n_in_bytes bytes
+// returns 0 if successful and -1 otherwise
+int expand_sk(const Params* p, const unsigned char* sk, unsigned char* seedH, unsigned char* priv)
+{
+	// detect failures evaluating SHAKE
+	bool fail = false;
+
+	// expand the secret seed to generate the seed for H, followed by the low-weight secret
+	ShakeReader reader;
+	if (shake_reader_init(&reader, sk, p->seedSkByteLen) != 0) { fail = true; };
+	if (shake_reader_bytes(&reader, seedH, p->seedHByteLen) != 0) { fail = true; };
+
+	// generate the low-weight secret
+	// this achieves a uniform distribution
+#ifdef SAMPLE_SECRET_CONSTANT_TIME
+	if (sample_fixed_weight_ct(p, &reader, priv) != 0) { fail = true; };
+#else
+	if (sample_fixed_weight(p->n, p->w, &reader, priv) != 0) { fail = true; };
+#endif // SAMPLE_SECRET_CONSTANT_TIME
+	zeroize(&reader, sizeof(ShakeReader));
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// Generates a key pair.
+int generate_keypair(const Params* p, unsigned char* sk, unsigned char* pk)
+{
+	// detect failures, e.g. generating randomness or evaluating SHAKE
+	bool fail = false;
+
+	// generate (the seed for) the private key
+	if (get_randomness(sk, p->seedSkByteLen) != 0) {
+		// something went wrong
+		fail = true;
+	}
+
+	// expand the seed to generate the seed for H (included in the public key) and the low-weight secret
+	unsigned char* priv = calloc(p->n_in_bytes, sizeof(unsigned char));
+	if (expand_sk(p, sk, pk, priv) != 0) { fail = true; };
+
+	// expand the seed to obtain H and compute the public key
+	ParityCheckMatrix H;
+	unsigned char* pub = pk + p->seedHByteLen;
+	if (expand_H(p, pk, &H) != 0) {
+		fail = true;
+	} else {
+		mult_H(p, &H, priv, pub);
+	}
+
+	// clean up
+	free_H(&H);
+	zeroize(priv, p->n_in_bytes);
+	free(priv);
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+/* -------------------------------------------------- */
+
+// Starts the challenge hash by absorbing the commitments com0, com1 and com2 of all rounds, in the order of the rounds.
+// The message is absorbed afterwards with Keccak_HashUpdate(), possibly in several parts, hence it is never copied.
+// returns 0 in case of a successful execution, -1 otherwise
+int challenge_hash_commitments(const Params* p, unsigned char* const* com0, unsigned char* const* com1, unsigned char* const* com2, Keccak_HashInstance* hashInstance)
+{
+	// detect failures evaluating SHAKE
+	bool fail = false;
+
+	if (Keccak_HashInitialize_SHAKE256(hashInstance) != SUCCESS) { fail = true; };
+	for (int i=0; i<p->t; i++) {
+		if (Keccak_HashUpdate(hashInstance, com0[i], p->commByteLen * 8) != SUCCESS) { fail = true; };
+		if (Keccak_HashUpdate(hashInstance, com1[i], p->commByteLen * 8) != SUCCESS) { fail = true; };
+		if (Keccak_HashUpdate(hashInstance, com2[i], p->commByteLen * 8) != SUCCESS) { fail = true; };
+	}
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// Completes the challenge hash after the commitments and the message have been absorbed
+// and writes the p->chHashByteLen bytes of the hash value to chHash.
+// returns 0 in case of a successful execution, -1 otherwise
+int challenge_hash_final(const Params* p, Keccak_HashInstance* hashInstance, unsigned char* chHash)
+{
+	// detect failures evaluating SHAKE
+	bool fail = false;
+
+	if (Keccak_HashFinal(hashInstance, NULL) != SUCCESS) { fail = true; };
+	if (Keccak_HashSqueeze(hashInstance, chHash, p->chHashByteLen * 8) != SUCCESS) { fail = true; };
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// Interpretes a hash value (specified in chHash) as p->t single, ternary challenges.
+// output: p->t numbers in {0,1,2}
+// note: challenges needs to provide at least p->t allocated bytes
+// returns 0 in case of a successful execution, -1 otherwise
+int get_challenges(const Params* p, const unsigned char* chHash, unsigned char* challenges)
+{
+	// detect failures evaluating SHAKE
+	bool fail = false;
+
+	// read the output of SHAKE256(chHash) two bits at a time, pairs of ones are discarded
+	ShakeReader reader;
+	if (shake_reader_init(&reader, chHash, p->chHashByteLen) != 0) { fail = true; };
+	size_t i = 0; // the current challenge
+	while (i < p->t && !fail) {
+		uint64_t ch = 0;
+		if (shake_reader_bits(&reader, 2, &ch) != 0) { fail = true; };
+		if (ch < 3) {
+			challenges[i] = (unsigned char) ch;
+			i++;
+		}
+	}
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+/* -------------------------------------------------- */
+/* Parallel processing of rounds */
+
+// The scratch memory of one thread processing rounds (see run_rounds), laid out at the start of its own workspace.
+typedef struct {
+	// the permutations of up to SHAKE_MAX_LANES rounds
+	Permutation perms[SHAKE_MAX_LANES];
+	// the scratch memory of mult_H_batch
+	MultHScratch multH;
+	// the inputs of commitment 0 of up to SHAKE_MAX_LANES rounds
+	unsigned char* in;
+	// a vector of n bits
+	unsigned char* vec;
+} RoundsScratch;
+
+// Lays out the scratch memory of one thread in the workspace.
+void rounds_scratch_init(const Params* p, RoundsScratch* scratch, Workspace* ws)
+{
+	for (size_t k=0; k<SHAKE_MAX_LANES; k++) {
+		perm_init_ws(p, &scratch->perms[k], ws);
+	}
+	mult_H_scratch_init(p, &scratch->multH, ws);
+	size_t len0 = p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen; // input length of commitment 0
+	scratch->in = (unsigned char*) ws_take(ws, SHAKE_MAX_LANES * len0);
+	scratch->vec = (unsigned char*) ws_take(ws, p->n_in_bytes);
+}
+
+// The size of the workspace of one thread processing rounds, a multiple of WS_ALIGNMENT.
+size_t rounds_scratch_len(const Params* p)
+{
+	RoundsScratch scratch;
+	Workspace ws = { NULL, 0 };
+	rounds_scratch_init(p, &scratch, &ws);
+	return ws_align(ws.used);
+}
+
+// A contiguous range of rounds, processed by one thread.
+typedef struct {
+	int (*fn)(const void*, void*, unsigned char*, size_t, size_t);
+	const void* arg;
+	void* data;
+	unsigned char* scratch;
+	size_t begin;
+	size_t end;
+	int res;
+} RoundsJob;
+
+void* run_rounds_job(void* arg)
+{
+	RoundsJob* job = (RoundsJob*) arg;
+	job->res = job->fn(job->arg, job->data, job->scratch, job->begin, job->end);
+	return NULL;
+}
+
+// Calls fn(arg, data, scratch, begin, end) for disjoint ranges covering the rounds 0,...,t-1, on up to numThreads threads.
+// The ranges are contiguous and of almost equal size, the last one is processed on the calling thread.
+// Every call gets its own workspace of rounds_scratch_len(p) bytes in scratch, there must be space for numThreads of them.
+// As every round is processed by exactly one call, the result does not depend on the number of threads.
+// returns 0 if all calls were successful and -1 otherwise
+int run_rounds(const Params* p, size_t numThreads, int (*fn)(const void*, void*, unsigned char*, size_t, size_t), const void* arg, void* data, unsigned char* scratch)
+{
+	size_t t = p->t;
+	if (numThreads > t) {
+		numThreads = t;
+	}
+	if (numThreads <= 1) {
+		return fn(arg, data, scratch, 0, t);
+	}
+
+	RoundsJob* jobs = (RoundsJob*) calloc(numThreads, sizeof(RoundsJob));
+	pthread_t* threads = (pthread_t*) calloc(numThreads, sizeof(pthread_t));
+	bool* started = (bool*) calloc(numThreads, sizeof(bool));
+	if ((jobs == NULL) || (threads == NULL) || (started == NULL)) {
+		free(jobs);
+		free(threads);
+		free(started);
+		return fn(arg, data, scratch, 0, t);
+	}
+
+	size_t scratchByteLen = rounds_scratch_len(p);
+	for (size_t j=0; j<numThreads; j++) {
+		jobs[j].fn = fn;
+		jobs[j].arg = arg;
+		jobs[j].data = data;
+		jobs[j].scratch = scratch + j * scratchByteLen;
+		jobs[j].begin = t * j / numThreads;
+		jobs[j].end = t * (j+1) / numThreads;
+	}
+	for (size_t j=0; j<numThreads-1; j++) {
+		started[j] = (pthread_create(&threads[j], NULL, run_rounds_job, &jobs[j]) == 0);
+		if (!started[j]) {
+			// process the range on the calling thread instead
+			run_rounds_job(&jobs[j]);
+		}
+	}
+	run_rounds_job(&jobs[numThreads-1]);
+
+	// collect the results
+	bool fail = false;
+	for (size_t j=0; j<numThreads; j++) {
+		if (started[j]) {
+			pthread_join(threads[j], NULL);
+		}
+		if (jobs[j].res != 0) { fail = true; };
+	}
+
+	free(jobs);
+	free(threads);
+	free(started);
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+/* -------------------------------------------------- */
+/* Signature encoding */
+
+// A signature is a string of bits: the challenge hash, one commitment per round and one response per round, followed by
+// zero padding up to p->sigByteLen bytes. Every field is appended at the current bit position, least significant bit first.
+// The length of each field only depends on the challenges, so the capacity of the signature is checked once for all fields
+// (see signature_bit_len()) and the fields are then packed without checks, in 64-bit words.
+
+// Reads 8 bytes at any address as a little-endian word.
+static inline uint64_t load_le64_word(const unsigned char* b)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	uint64_t w;
+	memcpy(&w, b, 8); // unaligned load
+	return w;
+#else
+	return load_le64(b, 8);
+#endif
+}
+
+// Writes a word to 8 bytes at any address in little-endian order.
+static inline void store_le64_word(unsigned char* b, uint64_t w)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	memcpy(b, &w, 8); // unaligned store
+#else
+	store_le64(b, w, 8);
+#endif
+}
+
+// Returns the length of the response to the challenge ch in the signature, in bits.
+size_t response_bit_len(const Params* p, unsigned char ch)
+{
+	if (ch == 0) {
+		// k0, k1, seed of y, seed of the permutation
+		return (2 * p->coinsCommByteLen + p->seedYByteLen + p->seedPermByteLen) * 8;
+	} else if (ch == 1) {
+		// k0, k2, y+priv, seed of the permutation
+		return (2 * p->coinsCommByteLen + p->seedPermByteLen) * 8 + p->n;
+	} else { // ch == 2
+		// k1, k2, perm(y), perm(priv)
+		return 2 * p->coinsCommByteLen * 8 + 2 * p->n;
+	}
+}
+
+// Returns the length of a signature with the given challenges of all rounds, without the zero padding, in bits.
+size_t signature_bit_len(const Params* p, const unsigned char* challenges)
+{
+	// challenge hash and one commitment per round
+	size_t bitLen = (p->chHashByteLen + p->t * p->commByteLen) * 8;
+	for (int i=0; i<p->t; i++) {
+		bitLen += response_bit_len(p, challenges[i]);
+	}
+	return bitLen;
+}
+
+// Appends the first dataBitLen bits of data to buf at bit position *pos, which is advanced.
+// The bits of buf before *pos are kept, the bits after the new position up to the end of its byte are set to zero.
+// buf must hold at least *pos+dataBitLen bits, this is not checked.
+void bits_write(unsigned char* buf, size_t* pos, const unsigned char* data, size_t dataBitLen)
+{
+	if (dataBitLen == 0) {
+		return;
+	}
+
+	unsigned char* out = buf + (*pos)/8; // the byte of buf in which we start writing
+	size_t offset = (*pos)%8; // the offset in bits within this byte
+	size_t fullBytes = dataBitLen/8; // full bytes of the data
+	size_t looseBits = dataBitLen%8; // valid bits in the last, partial byte of the data
+	(*pos) += dataBitLen;
+
+	// the bits left over after writing the full bytes of the data, less than 8
+	uint64_t rest = 0;
+	if (offset == 0) {
+		// byte-aligned, copy the full bytes
+		memcpy(out, data, fullBytes);
+	} else {
+		// each word written consists of the offset bits carried over and the next 64-offset bits of the data
+		uint64_t carry = out[0] & ((1u<<offset)-1);
+		size_t i = 0;
+		for (; i+8<=fullBytes; i+=8) {
+			uint64_t w = load_le64_word(data + i);
+			store_le64_word(out + i, carry | (w<<offset));
+			carry = w>>(64-offset);
+		}
+		for (; i<fullBytes; i++) {
+			out[i] = (unsigned char) (carry | ((uint64_t) data[i]<<offset));
+			carry = data[i]>>(8-offset);
+		}
+		rest = carry;
+	}
+	// the last, partial byte of the data (masked) after the bits carried over
+	if (looseBits != 0) {
+		rest |= (uint64_t) (data[fullBytes] & ((1u<<looseBits)-1)) << offset;
+	}
+	store_le64(out + fullBytes, rest, (offset + looseBits + 7)/8);
+}
+
+// Reads dataBitLen bits from buf at bit position *pos, which is advanced, and writes them to data.
+// The bits of the last byte of data beyond dataBitLen are set to zero.
+// buf must hold at least *pos+dataBitLen bits, this is not checked.
+void bits_read(const unsigned char* buf, size_t* pos, unsigned char* data, size_t dataBitLen)
+{
+	const unsigned char* in = buf + (*pos)/8; // the byte of buf from which we start reading
+	size_t offset = (*pos)%8; // the offset in bits within this byte
+	size_t fullBytes = dataBitLen/8; // full bytes of the data
+	size_t looseBits = dataBitLen%8; // valid bits in the last, partial byte of the data
+	(*pos) += dataBitLen;
+
+	if (offset == 0) {
+		// byte-aligned, copy the full bytes
+		memcpy(data, in, fullBytes);
+	} else {
+		// each word of the data consists of the bits of 9 bytes of buf
+		size_t i = 0;
+		for (; i+8<=fullBytes; i+=8) {
+			uint64_t w = (load_le64_word(in + i) >> offset) | ((uint64_t) in[i+8] << (64-offset));
+			store_le64_word(data + i, w);
+		}
+		for (; i<fullBytes; i++) {
+			data[i] = (unsigned char) ((in[i] >> offset) | (in[i+1] << (8-offset)));
+		}
+	}
+	// the last, partial byte of the data, reading one more byte of buf only if needed
+	if (looseBits != 0) {
+		unsigned int b = in[fullBytes] >> offset;
+		if (offset+looseBits > 8) {
+			b |= (unsigned int) in[fullBytes+1] << (8-offset);
+		}
+		data[fullBytes] = (unsigned char) (b & ((1u<<looseBits)-1));
+	}
+}
+
+/* -------------------------------------------------- */
+/* Signature generation */
+
+// domain separation of the inputs of SHAKE256 in the signature generation
+#define DOMAIN_ROUND_RANDOMNESS 0x01
+#define DOMAIN_DETERMINISTIC_KEY 0x02
+#define DOMAIN_DETERMINISTIC_SEED 0x03
+
+// Sets up a signing context for the secret key sk.
+int sign_ctx_init(const Params* p, const unsigned char* sk, SignCtx* ctx)
+{
+	ctx->p = *p;
+	ctx->H.data = NULL;
+	ctx->seedDet = NULL;
+	ctx->locked = true;
+	ctx->numThreads = 1;
+
+	// detect failures, e.g. evaluating SHAKE
+	bool fail = false;
+
+	// expand the secret seed
+	unsigned char* seedH = (unsigned char*) alloc_locked(p->seedHByteLen, &ctx->locked);
+	ctx->priv = (unsigned char*) alloc_locked(p->n_in_bytes, &ctx->locked);
+	if ((seedH == NULL) || (ctx->priv == NULL)) {
+		free_locked(seedH, p->seedHByteLen);
+		return -1;
+	}
+	if (expand_sk(p, sk, seedH, ctx->priv) != 0) { fail = true; };
+
+	// derive the key of the deterministic signatures, SHAKE256(sk || DOMAIN_DETERMINISTIC_KEY)
+	ctx->seedDet = (unsigned char*) alloc_locked(p->seedSkByteLen, &ctx->locked);
+	const unsigned char domain = DOMAIN_DETERMINISTIC_KEY;
+	Keccak_HashInstance hashInstance;
+	if (ctx->seedDet == NULL) {
+		fail = true;
+	} else if ((Keccak_HashInitialize_SHAKE256(&hashInstance) != SUCCESS)
+			|| (Keccak_HashUpdate(&hashInstance, sk, p->seedSkByteLen * 8) != SUCCESS)
+			|| (Keccak_HashUpdate(&hashInstance, &domain, 8) != SUCCESS)
+			|| (Keccak_HashFinal(&hashInstance, NULL) != SUCCESS)
+			|| (Keccak_HashSqueeze(&hashInstance, ctx->seedDet, p->seedSkByteLen * 8) != SUCCESS)) {
+		fail = true;
+	}
+	zeroize(&hashInstance, sizeof(Keccak_HashInstance));
+
+	// expand the seed to obtain H, and lock H as well
+	if (expand_H(p, seedH, &ctx->H) != 0) {
+		fail = true;
+	} else if (mlock(ctx->H.data, H_byte_len(&ctx->H)) != 0) {
+		ctx->locked = false;
+	}
+	free_locked(seedH, p->seedHByteLen);
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// Sets the number of threads used to compute the commitments.
+int sign_ctx_set_threads(SignCtx* ctx, size_t numThreads)
+{
+	if (numThreads == 0) {
+		return -1;
+	}
+	ctx->numThreads = numThreads;
+	return 0;
+}
+
+// Releases a signing context, overwriting the secret data.
+void sign_ctx_free(SignCtx* ctx)
+{
+	free_locked(ctx->priv, ctx->p.n_in_bytes);
+	ctx->priv = NULL;
+	free_locked(ctx->seedDet, ctx->p.seedSkByteLen);
+	ctx->seedDet = NULL;
+	if (ctx->H.data != NULL) {
+		zeroize(ctx->H.data, H_byte_len(&ctx->H));
+		munlock(ctx->H.data, H_byte_len(&ctx->H));
+		free_H(&ctx->H);
+	}
+}
+
+// Lays out the memory of a presignature in the workspace: first the data of all rounds (presig->data), as one array per kind of data
+// (the seeds of the permutations, the seeds of y, y, the random coins k0, perm(y)||k1, perm(y+priv)||k2 and the commitments),
+// followed by the scratch memory of the response phase, then the pointers to the data of each round.
+void presig_init_ws(const Params* p, Presig* presig, Workspace* ws)
+{
+	presig->p = *p;
+	presig->used = true; // there is nothing to use yet
+
+	size_t len12 = p->n_in_bytes + p->coinsCommByteLen; // input length of commitments 1 and 2
+	presig->dataByteLen = p->t * (p->seedPermByteLen + p->seedYByteLen + p->n_in_bytes + p->coinsCommByteLen + 2 * len12 + 3 * p->commByteLen)
+			+ p->chHashByteLen + p->t + p->n_in_bytes;
+	presig->data = (unsigned char*) ws_take(ws, presig->dataByteLen);
+	presig->seedPerm = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->seedY = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->y = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->k0 = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->k1 = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->k2 = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->permY = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->permYpriv = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->com0 = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->com1 = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	presig->com2 = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	if (presig->data == NULL) {
+		// only the size is counted
+		return;
+	}
+
+	// one array per kind of data, holding this data of all rounds
+	unsigned char* cur = presig->data;
+	unsigned char** const arrays[9] = { presig->seedPerm, presig->seedY, presig->y, presig->k0, presig->permY, presig->permYpriv, presig->com0, presig->com1, presig->com2 };
+	const size_t lens[9] = { p->seedPermByteLen, p->seedYByteLen, p->n_in_bytes, p->coinsCommByteLen, len12, len12, p->commByteLen, p->commByteLen, p->commByteLen };
+	for (int a=0; a<9; a++) {
+		for (int i=0; i<p->t; i++) {
+			arrays[a][i] = cur;
+			cur += lens[a];
+		}
+	}
+	// the random coins of commitments 1 and 2 follow the permuted vectors
+	for (int i=0; i<p->t; i++) {
+		presig->k1[i] = presig->permY[i] + p->n_in_bytes;
+		presig->k2[i] = presig->permYpriv[i] + p->n_in_bytes;
+	}
+	// the scratch memory of the response phase, overwritten together with the data
+	presig->respond.chHash = cur;
+	presig->respond.challenges = presig->respond.chHash + p->chHashByteLen;
+	presig->respond.temp_n = presig->respond.challenges + p->t;
+}
+
+// Allocates the memory of a presignature, one block for the data of all rounds and the pointers to it.
+int presig_init(const Params* p, Presig* presig)
+{
+	presig->locked = true;
+
+	Workspace ws = { NULL, 0 };
+	presig_init_ws(p, presig, &ws);
+	ws.base = (unsigned char*) alloc_locked(ws.used, &presig->locked);
+	if (ws.base == NULL) {
+		presig->data = NULL;
+		return -1;
+	}
+	ws.used = 0;
+	presig_init_ws(p, presig, &ws);
+
+	// successful execution
+	return 0;
+}
+
+// Releases a presignature, overwriting its data.
+void presig_free(Presig* presig)
+{
+	// the block starts with the data, its size is counted as in presig_init
+	Presig layout;
+	Workspace ws = { NULL, 0 };
+	presig_init_ws(&presig->p, &layout, &ws);
+	free_locked(presig->data, ws.used);
+	presig->data = NULL;
+}
+
+// The scratch memory of the commitment phase (see sign_commit), laid out in a workspace.
+typedef struct {
+	// H*y of every round
+	unsigned char** Hy;
+	// the master seed of a signing attempt, and the inputs and outputs of its expansion (see expand_master_seed)
+	unsigned char* masterSeed;
+	unsigned char* expandIn;
+	unsigned char* expandOut;
+	// the hash of the message, for deterministic signatures (2*p->seedSkByteLen bytes)
+	unsigned char* mu;
+	// the workspaces of the threads computing the commitments, rounds_scratch_len(p) bytes each
+	unsigned char* rounds;
+	size_t numThreads;
+} CommitScratch;
+
+// The length of the input of each lane expanding a master seed, and the length of its output (see expand_master_seed).
+static inline size_t master_seed_in_len(const Params* p)
+{
+	return p->seedSkByteLen + 2;
+}
+
+static inline size_t master_seed_lane_len(const Params* p)
+{
+	size_t roundByteLen = p->seedPermByteLen + p->seedYByteLen + 3 * p->coinsCommByteLen;
+	return (p->t + SHAKE_MAX_LANES - 1) / SHAKE_MAX_LANES * roundByteLen;
+}
+
+// Lays out the memory of a signature generation in the workspace, leaving out each part that is NULL:
+// a presignature (including the scratch memory of its response phase) and the scratch memory of the commitment phase on numThreads threads.
+void sign_ws_init(const Params* p, size_t numThreads, Presig* presig, CommitScratch* commit, Workspace* ws)
+{
+	if (presig != NULL) {
+		presig_init_ws(p, presig, ws);
+		presig->locked = false;
+	}
+	if (commit != NULL) {
+		commit->Hy = ws_take_arrays(ws, p->t, p->r_in_bytes);
+		commit->masterSeed = (unsigned char*) ws_take(ws, p->seedSkByteLen);
+		commit->expandIn = (unsigned char*) ws_take(ws, SHAKE_MAX_LANES * master_seed_in_len(p));
+		commit->expandOut = (unsigned char*) ws_take(ws, SHAKE_MAX_LANES * master_seed_lane_len(p));
+		commit->mu = (unsigned char*) ws_take(ws, 2 * p->seedSkByteLen);
+		commit->rounds = (unsigned char*) ws_take(ws, numThreads * rounds_scratch_len(p));
+		commit->numThreads = numThreads;
+	}
+}
+
+// Allocates the memory of a signature generation in one block that is locked into RAM if possible, and lays it out (see sign_ws_init).
+// returns the workspace, to be released with free_locked(ws.base, ws.used), its base is NULL if the allocation failed
+Workspace sign_ws_alloc(const Params* p, size_t numThreads, Presig* presig, CommitScratch* commit)
+{
+	Workspace ws = { NULL, 0 };
+	sign_ws_init(p, numThreads, presig, commit, &ws);
+	bool locked;
+	ws.base = (unsigned char*) alloc_locked(ws.used, &locked);
+	if (ws.base != NULL) {
+		ws.used = 0;
+		sign_ws_init(p, numThreads, presig, commit, &ws);
+	}
+	return ws;
+}
+
+// The data shared by the threads computing the commitments of one presignature.
+typedef struct {
+	// the presignature, holding the randomness of all rounds
+	Presig* presig;
+	// H*y of every round
+	unsigned char** Hy;
+} SignRounds;
+
+// Expands y and computes the commitments of the rounds begin,...,end-1.
+// The randomness of these rounds must already be stored in the presignature.
+// arg points to the signing context and data to the shared SignRounds, as required by run_rounds
+// returns 0 if successful and -1 otherwise
+int sign_commit_rounds(const void* arg, void* data, unsigned char* scratch, size_t begin, size_t end)
+{
+	const SignCtx* ctx = (const SignCtx*) arg;
+	const SignRounds* sr = (const SignRounds*) data;
+	Presig* presig = sr->presig;
+	const Params* p = &ctx->p;
+	const ParityCheckMatrix* H = &ctx->H;
+	const unsigned char* priv = ctx->priv;
+
+	unsigned char** seedPerm = presig->seedPerm;
+	unsigned char** seedY = presig->seedY;
+	unsigned char** y = presig->y;
+	unsigned char** k0 = presig->k0;
+	unsigned char** permY = presig->permY;
+	unsigned char** permYpriv = presig->permYpriv;
+	unsigned char** com0 = presig->com0;
+	unsigned char** com1 = presig->com1;
+	unsigned char** com2 = presig->com2;
+	unsigned char** Hy = sr->Hy;
+
+	// the scratch memory of this thread
+	RoundsScratch rs;
+	Workspace ws = { scratch, 0 };
+	rounds_scratch_init(p, &rs, &ws);
+
+	// detect failures, e.g. evaluating SHAKE
+	bool fail = false;
+
+	// generate y from the seeds
+	if (shake256_many(y + begin, p->n_in_bytes, (const unsigned char* const*) (seedY + begin), p->seedYByteLen, end - begin) != 0) { fail = true; };
+	for (size_t i=begin; i<end; i++) {
+		y[i][p->n_in_bytes-1] &= (unsigned char) ((1<<(((p->n+7)%8)+1))-1); // make sure the invalid bits are zero
+	}
+
+	// compute H*y for all rounds at once
+	size_t count = end - begin;
+	if (mult_H_batch(p, H, (const unsigned char* const*) (y + begin), count, Hy + begin, &rs.multH) != 0) { fail = true; };
+
+	// generate commitments, for up to SHAKE_MAX_LANES rounds at once
+	size_t len0 = p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen; // input length of commitment 0
+	size_t len12 = p->n_in_bytes + p->coinsCommByteLen; // input length of commitments 1 and 2
+	unsigned char* tempData = rs.in;
+	Permutation* perms = rs.perms;
+	for (size_t c=begin; (c<end) && !fail; c+=SHAKE_MAX_LANES) {
+		size_t lanes = (end - c < SHAKE_MAX_LANES) ? end - c : SHAKE_MAX_LANES;
+		unsigned char* temp0[SHAKE_MAX_LANES];
+		const unsigned char* in12[2 * SHAKE_MAX_LANES];
+		unsigned char* com12[2 * SHAKE_MAX_LANES];
+		// the permutations are secret, they are applied to y and priv while they are generated, in constant time,
+		// perm(y) and perm(priv) are kept for the responses and followed by the random coins k1 and k2
+		const unsigned char* words[2 * SHAKE_MAX_LANES];
+		unsigned char* res[2 * SHAKE_MAX_LANES];
+		for (size_t k=0; k<lanes; k++) {
+			words[2*k] = y[c+k];
+			words[2*k+1] = priv;
+			res[2*k] = permY[c+k];
+			res[2*k+1] = permYpriv[c+k];
+		}
+		if (perm_generate_many(p, (const unsigned char* const*) (seedPerm + c), lanes, perms, 2, words, res) != 0) { fail = true; };
+		for (size_t k=0; k<lanes; k++) {
+			size_t i = c + k;
+			temp0[k] = tempData + k * len0;
+			in12[k] = permY[i];
+			in12[lanes + k] = permYpriv[i];
+			com12[k] = com1[i];
+			com12[lanes + k] = com2[i];
+			// commitment 0
+			memcpy(temp0[k], Hy[i], p->r_in_bytes); // H*y
+			memcpy(temp0[k] + p->r_in_bytes, seedPerm[i], p->seedPermByteLen); // permutation
+			memcpy(temp0[k] + p->r_in_bytes + p->seedPermByteLen, k0[i], p->coinsCommByteLen); // random coins
+			// commitments 1 and 2, from perm(y) and perm(y+priv) = perm(y) + perm(priv)
+			add_in_F2n(p, permY[i], permYpriv[i], permYpriv[i]);
+			// y is not needed anymore, keep y+priv for the response to challenge 1
+			add_in_F2n(p, y[i], priv, y[i]);
+		}
+		if (shake256_many(com0 + c, p->commByteLen, (const unsigned char* const*) temp0, len0, lanes) != 0) { fail = true; };
+		if (shake256_many(com12, p->commByteLen, in12, len12, 2 * lanes) != 0) { fail = true; };
+	}
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
 
-	// expand the seed to generate the seed for H and include it in the public key
-	if (Keccak_HashSqueeze(&hashInstance, pk, p->seedHByteLen * 8) != SUCCESS) {
-		// something went wrong in the evaluation of the hash function
+// Expands the master seed of a signing attempt (p->seedSkByteLen bytes, scratch->masterSeed) to the seeds and random coins of all rounds.
+// Lane l of SHAKE_MAX_LANES SHAKE256 instances absorbs masterSeed || DOMAIN_ROUND_RANDOMNESS || l and its output provides
+// the rounds l, l+SHAKE_MAX_LANES, l+2*SHAKE_MAX_LANES, ... one after the other, each as seedPerm || seedY || k0 || k1 || k2.
+// The lanes do not depend on the kernels in use, hence neither does the randomness.
+// returns 0 if successful and -1 otherwise
+int expand_master_seed(const Params* p, const CommitScratch* scratch, Presig* presig)
+{
+	// detect failures evaluating SHAKE
+	bool fail = false;
+
+	size_t roundByteLen = p->seedPermByteLen + p->seedYByteLen + 3 * p->coinsCommByteLen;
+	size_t laneByteLen = master_seed_lane_len(p);
+	size_t inByteLen = master_seed_in_len(p);
+	const unsigned char* in[SHAKE_MAX_LANES];
+	unsigned char* out[SHAKE_MAX_LANES];
+	for (int l=0; l<SHAKE_MAX_LANES; l++) {
+		unsigned char* cur = scratch->expandIn + l * inByteLen;
+		memcpy(cur, scratch->masterSeed, p->seedSkByteLen);
+		cur[p->seedSkByteLen] = DOMAIN_ROUND_RANDOMNESS;
+		cur[p->seedSkByteLen + 1] = (unsigned char) l;
+		in[l] = cur;
+		out[l] = scratch->expandOut + l * laneByteLen;
+	}
+	if (shake256_many(out, laneByteLen, in, inByteLen, SHAKE_MAX_LANES) != 0) { fail = true; };
+
+	// distribute the output over the rounds
+	for (int i=0; i<p->t; i++) {
+		const unsigned char* cur = out[i % SHAKE_MAX_LANES] + (i / SHAKE_MAX_LANES) * roundByteLen;
+		memcpy(presig->seedPerm[i], cur, p->seedPermByteLen);
+		cur += p->seedPermByteLen;
+		memcpy(presig->seedY[i], cur, p->seedYByteLen);
+		cur += p->seedYByteLen;
+		memcpy(presig->k0[i], cur, p->coinsCommByteLen);
+		cur += p->coinsCommByteLen;
+		memcpy(presig->k1[i], cur, p->coinsCommByteLen);
+		cur += p->coinsCommByteLen;
+		memcpy(presig->k2[i], cur, p->coinsCommByteLen);
+	}
+
+	// successful execution?
+	if (fail) {
 		return -1;
+	} else {
+		return 0;
 	}
+}
 
-	// allocate memory for H
-	unsigned char** H = calloc(p->r, sizeof(unsigned char*));
-	// expand the seed to obtain H
-	unsigned char* temp = calloc(p->n_in_bytes * p->r, sizeof(unsigned char));
-	if (SHAKE256(temp, p->n_in_bytes * p->r, pk, p->seedHByteLen) != 0) { fail = true; };
-	for (int i=0; i<p->r; i++) {
-		H[i] = calloc(p->n_in_bytes, sizeof(unsigned char));
-		memcpy(H[i], temp+i*p->n_in_bytes, p->n_in_bytes);
-		// make sure the invalid bits are zero
-		H[i][(p->n_in_bytes -1)] &= (unsigned char) ((1<<(((p->n+7)%8)+1))-1); // mask the last block
+// Computes the commitments of all rounds from the randomness in presig, on scratch->numThreads threads,
+// and absorbs them into presig->chHashInstance.
+// returns 0 if successful and -1 otherwise
+int sign_commit_randomness(const SignCtx* ctx, Presig* presig, const CommitScratch* scratch)
+{
+	const Params* p = &ctx->p;
+
+	// detect failures evaluating SHAKE
+	bool fail = false;
+
+	// generate commitments
+	SignRounds sr = { presig, scratch->Hy };
+	if (run_rounds(p, scratch->numThreads, sign_commit_rounds, ctx, &sr, scratch->rounds) != 0) { fail = true; };
+	// absorb the commitments into the challenge hash already, only the message is left for sign_respond()
+	if (challenge_hash_commitments(p, presig->com0, presig->com1, presig->com2, &presig->chHashInstance) != 0) { fail = true; };
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		presig->used = false;
+		return 0;
 	}
-	free(temp);
+}
 
-	// generate the low-weight secret
-	// this achieves a uniform distribution
-	unsigned char* priv = calloc(p->n_in_bytes, sizeof(unsigned char*));
-	size_t current_weight = 0;
-	for (int i=0; i<p->n; i++) {
-		size_t t = 0;
-		if (get_rand_uint(p->n - i, &t, &hashInstance) != 0) {
-			// something went wrong during the generation of the random number
-			return -1;
+// The message-independent commitment phase of the signature generation.
+// Generates the randomness and the commitments of all rounds and stores them in presig.
+// The randomness is drawn (or expanded from a master seed) on the calling thread, the commitments are computed on scratch->numThreads threads.
+// returns 0 if successful and -1 otherwise
+int sign_commit(const SignCtx* ctx, Presig* presig, const CommitScratch* scratch)
+{
+	const Params* p = &ctx->p;
+
+	// detect failures, e.g. generating randomness or evaluating SHAKE
+	bool fail = false;
+
+	// generate randomness
+#ifdef SIGN_EXPAND_MASTER_SEED
+	// one master seed for this attempt, the randomness of the rounds is expanded from it
+	if (get_randomness(scratch->masterSeed, p->seedSkByteLen) != 0) { fail = true; };
+	if (expand_master_seed(p, scratch, presig) != 0) { fail = true; };
+#else
+	for (int i=0; i<p->t; i++) {
+		// get random permutation
+		if (get_randomness(presig->seedPerm[i], p->seedPermByteLen) != 0) { fail = true; };
+		// sample random seed (y is generated from the seed later)
+		if (get_randomness(presig->seedY[i], p->seedYByteLen) != 0) { fail = true; };
+		// generate random coins
+		if (get_randomness(presig->k0[i], p->coinsCommByteLen) != 0) { fail = true; };
+		if (get_randomness(presig->k1[i], p->coinsCommByteLen) != 0) { fail = true; };
+		if (get_randomness(presig->k2[i], p->coinsCommByteLen) != 0) { fail = true; };
+	}
+#endif // SIGN_EXPAND_MASTER_SEED
+
+	// generate commitments
+	if (sign_commit_randomness(ctx, presig, scratch) != 0) { fail = true; };
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// The response phase of the signature generation.
+// Computes the challenge from hashInstance, i.e. presig->chHashInstance after absorbing the message, and writes the signature to sig.
+// *success is set to false if the signature exceeds p->sigByteLen bytes
+// returns 0 if successful and -1 otherwise
+int sign_respond(const SignCtx* ctx, const Presig* presig, Keccak_HashInstance* hashInstance, unsigned char* sig, bool* success, const RespondScratch* scratch)
+{
+	const Params* p = &ctx->p;
+
+	unsigned char* const* seedPerm = presig->seedPerm;
+	unsigned char* const* seedY = presig->seedY;
+	unsigned char* const* ypriv = presig->y; // y+priv after the commitment phase
+	unsigned char* const* k0 = presig->k0;
+	unsigned char* const* k1 = presig->k1;
+	unsigned char* const* k2 = presig->k2;
+	unsigned char* const* permY = presig->permY;
+	unsigned char* const* permYpriv = presig->permYpriv;
+	unsigned char* const* com0 = presig->com0;
+	unsigned char* const* com1 = presig->com1;
+	unsigned char* const* com2 = presig->com2;
+
+	// detect failures, e.g. evaluating SHAKE
+	bool fail = false;
+
+	*success = true;
+
+	// current position in the signature, in bits
+	size_t pos = 0;
+
+	// zero signature
+	memset(sig, 0, p->sigByteLen);
+
+	unsigned char* chHash = scratch->chHash;
+
+	unsigned char* challenges = scratch->challenges;
+
+	// get challenge: complete the hash of the commitments (absorbed by sign_commit()) and the message
+	if (challenge_hash_final(p, hashInstance, chHash) != 0) { fail = true; };
+	// interpret as single ternary challenges
+	if (get_challenges(p, chHash, challenges) != 0) { fail = true; }; // every byte in "challenge" is a ternary challenge
+
+	// the length of the signature only depends on the challenges, check once that all fields fit
+	if (signature_bit_len(p, challenges) > p->sigByteLen*8) {
+		*success = false;
+	}
+
+	// include the challenge hash in the signature
+	if (*success) {
+		bits_write(sig, &pos, chHash, p->chHashByteLen*8);
+	}
+
+	// include one commitment per round in the signature
+	for (int i=0; (i<p->t) && *success; i++) {
+		if (challenges[i] == 0) {
+			bits_write(sig, &pos, com2[i], p->commByteLen*8);
+		} else if (challenges[i] == 1) {
+			bits_write(sig, &pos, com1[i], p->commByteLen*8);
+		} else { // challenges[i] == 2
+			bits_write(sig, &pos, com0[i], p->commByteLen*8);
 		}
-		if (t < (p->w - current_weight)) {
-			// set bit to 1
-			priv[i/8] = (priv[i/8] & (~(1<<(i%8)))) | (1<<(i%8));
-			current_weight++;
-		} else {
-			// set bit to 0
-			priv[i/8] = (priv[i/8] & (~(1<<(i%8))));
+	}
+
+	// generate response and signature, from the vectors kept by the commitment phase
+	unsigned char* temp_n = scratch->temp_n;
+	for (int i=0; (i<p->t) && *success && !fail; i++) {
+		if (challenges[i] == 0) {
+			// include the random coins used in two of the initial commitments
+			bits_write(sig, &pos, k0[i], p->coinsCommByteLen*8);
+			bits_write(sig, &pos, k1[i], p->coinsCommByteLen*8);
+			// include the seed of y
+			bits_write(sig, &pos, seedY[i], p->seedYByteLen*8);
+			// include the seed of the permutation
+			bits_write(sig, &pos, seedPerm[i], p->seedPermByteLen*8);
+		} else if (challenges[i] == 1) {
+			// include the random coins used in two of the initial commitments
+			bits_write(sig, &pos, k0[i], p->coinsCommByteLen*8);
+			bits_write(sig, &pos, k2[i], p->coinsCommByteLen*8);
+			// include y+priv
+			bits_write(sig, &pos, ypriv[i], p->n);
+			// include the seed of the permutation
+			bits_write(sig, &pos, seedPerm[i], p->seedPermByteLen*8);
+		} else { // challenges[i] == 2
+			// include the random coins used in two of the initial commitments
+			bits_write(sig, &pos, k1[i], p->coinsCommByteLen*8);
+			bits_write(sig, &pos, k2[i], p->coinsCommByteLen*8);
+			// include perm(y)
+			bits_write(sig, &pos, permY[i], p->n);
+			// include perm(priv) = perm(y) + perm(y+priv)
+			add_in_F2n(p, permY[i], permYpriv[i], temp_n);
+			bits_write(sig, &pos, temp_n, p->n);
 		}
 	}
 
-	// compute the public key
-	unsigned char* pub = pk + p->seedHByteLen;
-	mult_H(p, H, priv, pub);
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
 
-	// clean up
-	for (int i=0; i<p->r; i++) {
-		free(H[i]);
+// Generates a presignature, i.e. runs the commitment phase of the signature generation in advance.
+int presig_generate(const SignCtx* ctx, Presig* presig)
+{
+	CommitScratch commit;
+	Workspace ws = sign_ws_alloc(&ctx->p, ctx->numThreads, NULL, &commit);
+	if (ws.base == NULL) {
+		return -1;
 	}
-	free(H);
-	free(priv);
+	int res = sign_commit(ctx, presig, &commit);
+	free_locked(ws.base, ws.used);
+	return res;
+}
+
+// This method generates a signature on a given message, using a presignature.
+int sign_with_presig(const SignCtx* ctx, Presig* presig, const unsigned char* message, size_t messageByteLen, unsigned char* sig)
+{
+	// a presignature must never be used twice
+	if (presig->used) {
+		return -1;
+	}
+	presig->used = true;
+
+	// the scratch memory of the response phase is part of the presignature, no memory is allocated here
+	bool success;
+	int res = 0;
+	Keccak_HashInstance hashInstance = presig->chHashInstance;
+	if (Keccak_HashUpdate(&hashInstance, message, messageByteLen * 8) != SUCCESS) { res = -1; };
+	if ((res == 0) && (sign_respond(ctx, presig, &hashInstance, sig, &success, &presig->respond) != 0)) { res = -1; };
+	zeroize(presig->data, presig->dataByteLen);
+	if (res != 0) {
+		return -1;
+	}
+	if (!success) {
+		// the signature does not fit into p->sigByteLen bytes, start over with fresh commitments
+		return sign_with_ctx(ctx, message, messageByteLen, sig);
+	}
+
+	// successful execution
+	return 0;
+}
+
+// Generates a signature on a given message in the memory laid out by sign_ws_init, trying until the signature fits into p->sigByteLen bytes.
+// returns 0 if successful and -1 otherwise
+int sign_with_scratch(const SignCtx* ctx, Presig* presig, const CommitScratch* commit, const unsigned char* message, size_t messageByteLen, unsigned char* sig)
+{
+	// detect failures, e.g. generating randomness or evaluating SHAKE
+	bool fail = false;
+
+	// loop: try to generate a signature (failure due to signature too large)
+	bool success;
+	do {
+		if (sign_commit(ctx, presig, commit) != 0) { fail = true; };
+		Keccak_HashInstance hashInstance = presig->chHashInstance;
+		if (Keccak_HashUpdate(&hashInstance, message, messageByteLen * 8) != SUCCESS) { fail = true; };
+		if (sign_respond(ctx, presig, &hashInstance, sig, &success, &presig->respond) != 0) { fail = true; };
+	} while (!success);
 
 	// successful execution?
 	if (fail) {
@@ -495,532 +2769,684 @@ int generate_keypair(const Params* p, unsigned char* sk, unsigned char* pk)
 	}
 }
 
-/* -------------------------------------------------- */
+// This method generates a signature on a given message, using the data in the signing context.
+int sign_with_ctx(const SignCtx* ctx, const unsigned char* message, size_t messageByteLen, unsigned char* sig)
+{
+	// the commitments of the current try and the scratch memory, in one block
+	Presig presig;
+	CommitScratch commit;
+	Workspace ws = sign_ws_alloc(&ctx->p, ctx->numThreads, &presig, &commit);
+	if (ws.base == NULL) {
+		return -1;
+	}
 
-// Interpretes a hash value (specified in chHash) as p->t single, ternary challenges.
-// output: p->t numbers in {0,1,2}
-// note: challenges needs to provide at least p->t allocated bytes
-// returns 0 in case of a successful execution, -1 otherwise
-int get_challenges(const Params* p, const unsigned char* chHash, unsigned char* challenges)
+	int res = sign_with_scratch(ctx, &presig, &commit, message, messageByteLen, sig);
+
+	// free memory
+	free_locked(ws.base, ws.used);
+	return res;
+}
+
+// The size of the workspace of sign_with_ctx_ws().
+size_t sign_workspace_size(const Params* p)
+{
+	Presig presig;
+	CommitScratch commit;
+	Workspace ws = { NULL, 0 };
+	sign_ws_init(p, 1, &presig, &commit, &ws);
+	return ws.used;
+}
+
+// This method generates a signature on a given message, using the data in the signing context and the workspace supplied by the caller.
+int sign_with_ctx_ws(const SignCtx* ctx, const unsigned char* message, size_t messageByteLen, unsigned char* sig, void* workspace)
+{
+	// the workspace must be aligned to a cache line
+	if (((uintptr_t) workspace) % WS_ALIGNMENT != 0) {
+		return -1;
+	}
+
+	// the commitments of the current try and the scratch memory, laid out in the workspace, on the calling thread only
+	Presig presig;
+	CommitScratch commit;
+	Workspace ws = { (unsigned char*) workspace, 0 };
+	sign_ws_init(&ctx->p, 1, &presig, &commit, &ws);
+
+	int res = sign_with_scratch(ctx, &presig, &commit, message, messageByteLen, sig);
+
+	// overwrite the secret data
+	zeroize(workspace, ws.used);
+	return res;
+}
+
+// Derives the master seed of a deterministic signing attempt (p->seedSkByteLen bytes) as
+// SHAKE256(DOMAIN_DETERMINISTIC_SEED || ctx->seedDet || mu || counter || rnd), with the counter as 8 bytes in little-endian order.
+// returns 0 if successful and -1 otherwise
+int derive_master_seed(const SignCtx* ctx, const unsigned char* mu, size_t muByteLen, const unsigned char* rnd, size_t rndByteLen, uint64_t counter, unsigned char* masterSeed)
 {
+	const Params* p = &ctx->p;
+
 	// detect failures evaluating SHAKE
 	bool fail = false;
 
-	size_t no_bits = 0;
-	size_t i = 0; // the current challenge
-	size_t diglen = p->t * 2;
-	unsigned char* e = (unsigned char*) calloc(diglen, sizeof(unsigned char));
-	if (SHAKE256(e, diglen, chHash, p->chHashByteLen) != 0) { fail = true; };
-	while (i < p->t) {
-		if ((no_bits+2 + 7)/8 > diglen) {
-			// we need more digest bytes
-			diglen += 10;
-			e = realloc(e, diglen * sizeof(unsigned char));
-			if (SHAKE256(e, diglen, chHash, p->chHashByteLen) != 0) { fail = true; };
-		}
-		unsigned char ch = (e[no_bits/8] & (0x03<<(no_bits%8))) >> (no_bits%8);
-		if (ch < 3) {
-			challenges[i] = ch;
-			i++;
+	const unsigned char domain = DOMAIN_DETERMINISTIC_SEED;
+	unsigned char counterBytes[8];
+	store_le64(counterBytes, counter, 8);
+
+	Keccak_HashInstance hashInstance;
+	if (Keccak_HashInitialize_SHAKE256(&hashInstance) != SUCCESS) { fail = true; };
+	if (Keccak_HashUpdate(&hashInstance, &domain, 8) != SUCCESS) { fail = true; };
+	if (Keccak_HashUpdate(&hashInstance, ctx->seedDet, p->seedSkByteLen * 8) != SUCCESS) { fail = true; };
+	if (Keccak_HashUpdate(&hashInstance, mu, muByteLen * 8) != SUCCESS) { fail = true; };
+	if (Keccak_HashUpdate(&hashInstance, counterBytes, 8 * 8) != SUCCESS) { fail = true; };
+	if ((rnd != NULL) && (Keccak_HashUpdate(&hashInstance, rnd, rndByteLen * 8) != SUCCESS)) { fail = true; };
+	if (Keccak_HashFinal(&hashInstance, NULL) != SUCCESS) { fail = true; };
+	if (Keccak_HashSqueeze(&hashInstance, masterSeed, p->seedSkByteLen * 8) != SUCCESS) { fail = true; };
+	zeroize(&hashInstance, sizeof(Keccak_HashInstance));
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// This method generates a deterministic (or, with rnd, hedged) signature on a given message, using the data in the signing context.
+// The randomness of every attempt is expanded from a master seed that is derived from the key, the message, rnd and the number of the attempt.
+int sign_deterministic_with_ctx(const SignCtx* ctx, const unsigned char* message, size_t messageByteLen, const unsigned char* rnd, size_t rndByteLen, unsigned char* sig)
+{
+	const Params* p = &ctx->p;
+
+	// detect failures, e.g. evaluating SHAKE
+	bool fail = false;
+
+	// the commitments of the current try and the scratch memory, in one block
+	Presig presig;
+	CommitScratch commit;
+	Workspace ws = sign_ws_alloc(p, ctx->numThreads, &presig, &commit);
+	if (ws.base == NULL) {
+		return -1;
+	}
+
+	// hash the message, twice as long as the seeds to avoid collisions
+	size_t muByteLen = 2 * p->seedSkByteLen;
+	if (SHAKE256(commit.mu, muByteLen, message, messageByteLen) != 0) { fail = true; };
+
+	// loop: try to generate a signature (failure due to signature too large), every try with its own master seed
+	bool success;
+	uint64_t counter = 0;
+	do {
+		if (derive_master_seed(ctx, commit.mu, muByteLen, rnd, rndByteLen, counter, commit.masterSeed) != 0) { fail = true; };
+		if (expand_master_seed(p, &commit, &presig) != 0) { fail = true; };
+		if (sign_commit_randomness(ctx, &presig, &commit) != 0) { fail = true; };
+		Keccak_HashInstance hashInstance = presig.chHashInstance;
+		if (Keccak_HashUpdate(&hashInstance, message, messageByteLen * 8) != SUCCESS) { fail = true; };
+		if (sign_respond(ctx, &presig, &hashInstance, sig, &success, &presig.respond) != 0) { fail = true; };
+		counter++;
+	} while (!success);
+
+	// free memory
+	free_locked(ws.base, ws.used);
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+// This method generates a signature on a given message.
+int sign(const Params* p, const unsigned char* sk, const unsigned char* message, size_t messageByteLen, unsigned char* sig)
+{
+	SignCtx ctx;
+	if (sign_ctx_init(p, sk, &ctx) != 0) {
+		sign_ctx_free(&ctx);
+		return -1;
+	}
+	int res = sign_with_ctx(&ctx, message, messageByteLen, sig);
+	sign_ctx_free(&ctx);
+	return res;
+}
+
+// Starts a signature on a message that is given in parts: runs the commitment phase, before any part of the message is known.
+// All memory of the signature generation, including the scratch memory of sign_final(), is allocated here.
+int sign_init(const SignCtx* ctx, SignStream* stream)
+{
+	stream->ctx = ctx;
+	if (presig_init(&ctx->p, &stream->presig) != 0) {
+		return -1;
+	}
+	// the commitments are absorbed into stream->presig.chHashInstance, the parts of the message follow
+	return presig_generate(ctx, &stream->presig);
+}
+
+// Absorbs the next part of the message into the challenge hash.
+int sign_update(SignStream* stream, const unsigned char* part, size_t partByteLen)
+{
+	// the signature must not be completed yet
+	if (stream->presig.used) {
+		return -1;
+	}
+	if (Keccak_HashUpdate(&stream->presig.chHashInstance, part, partByteLen * 8) != SUCCESS) {
+		return -1;
+	}
+	return 0;
+}
+
+// Completes the signature on the parts of the message absorbed by sign_update().
+int sign_final(SignStream* stream, unsigned char* sig, bool* success)
+{
+	// the commitments must never be used twice
+	if (stream->presig.used) {
+		*success = false;
+		return -1;
+	}
+	stream->presig.used = true;
+
+	// the scratch memory of the response phase was allocated by sign_init() as part of stream->presig
+	int res = 0;
+	if (sign_respond(stream->ctx, &stream->presig, &stream->presig.chHashInstance, sig, success, &stream->presig.respond) != 0) {
+		*success = false;
+		res = -1;
+	}
+	zeroize(stream->presig.data, stream->presig.dataByteLen);
+	return res;
+}
+
+// Releases the commitments of a signature on a message given in parts.
+void sign_stream_free(SignStream* stream)
+{
+	presig_free(&stream->presig);
+}
+/* -------------------------------------------------- */
+/* Pool of presignatures */
+
+// Sets up an empty queue with room for at least capacity indices.
+// returns 0 if successful and -1 otherwise
+int presig_queue_init(PresigQueue* q, size_t capacity)
+{
+	size_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	q->cells = (PresigQueueCell*) calloc(size, sizeof(PresigQueueCell));
+	if (q->cells == NULL) {
+		return -1;
+	}
+	for (size_t i=0; i<size; i++) {
+		atomic_init(&q->cells[i].seq, i);
+	}
+	q->mask = size - 1;
+	atomic_init(&q->tail, 0);
+	atomic_init(&q->head, 0);
+
+	// successful execution
+	return 0;
+}
+
+// Appends index to the queue, without taking a lock.
+// A cell can be written to if its sequence number equals the position, and read from if it equals the position plus one.
+// returns false if the queue is full
+bool presig_queue_push(PresigQueue* q, size_t index)
+{
+	size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	while (true) {
+		PresigQueueCell* cell = &q->cells[pos & q->mask];
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+		if (diff == 0) {
+			// the cell is free, try to claim it
+			if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+				cell->index = index;
+				atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+				return true;
+			}
+		} else if (diff < 0) {
+			// the queue is full
+			return false;
+		} else {
+			// another thread was faster
+			pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+		}
+	}
+}
+
+// Takes the first index out of the queue, without taking a lock.
+// returns false if the queue is empty
+bool presig_queue_pop(PresigQueue* q, size_t* index)
+{
+	size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+	while (true) {
+		PresigQueueCell* cell = &q->cells[pos & q->mask];
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+		if (diff == 0) {
+			// the cell is filled, try to claim it
+			if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+				*index = cell->index;
+				atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+				return true;
+			}
+		} else if (diff < 0) {
+			// the queue is empty
+			return false;
+		} else {
+			// another thread was faster
+			pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+		}
+	}
+}
+
+// Wakes the workers of the pool, such that they refill it up to the high watermark.
+void presig_pool_refill(PresigPool* pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+	if (!pool->refilling) {
+		pool->refilling = true;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+// The worker threads of a pool.
+// While refilling, a worker takes the index of a used presignature, generates it and marks it as ready.
+// The refilling ends as soon as all presignatures are ready or being generated.
+void* presig_pool_worker(void* arg)
+{
+	PresigPool* pool = (PresigPool*) arg;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (!pool->stop && !pool->refilling) {
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		}
+		if (pool->stop) {
+			break;
+		}
+
+		size_t index;
+		if (!presig_queue_pop(&pool->empty, &index)) {
+			// the pool is full
+			pool->refilling = false;
+			continue;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+
+		bool fail = (presig_generate(pool->ctx, &pool->presigs[index]) != 0);
+		if (!fail) {
+			// count first, such that readyCount never is less than the number of indices in the queue
+			atomic_fetch_add(&pool->readyCount, 1);
+			presig_queue_push(&pool->ready, index);
+		} else {
+			presig_queue_push(&pool->empty, index);
 		}
-		no_bits += 2;
-	}
-	// free memory
-	free(e);
 
-	// successful execution?
-	if (fail) {
-		return -1;
-	} else {
-		return 0;
+		pthread_mutex_lock(&pool->mutex);
+		if (fail) {
+			// do not retry right away, but with the next refill
+			pool->refilling = false;
+		}
 	}
-}
-
-/* -------------------------------------------------- */
-/* Signature generation */
+	pthread_mutex_unlock(&pool->mutex);
 
-// This method appends the first dataBitLen bits from data to sig.
-// pos is the current position in sig and is updated by this function
-// returns one bit indicating if the data still fit into the signature or not
-bool include_in_signature(const Params* p, unsigned char* sig, size_t* pos, const unsigned char* data, size_t dataBitLen)
-{
-	if (((*pos)+dataBitLen) <= (p->sigByteLen*8)) {
-		// data still fits into the signature
-
-		if (dataBitLen == 0) {
-			return true;
-		}
-
-		size_t start_byte = (*pos)/8; // the byte of the signature in which we will start writing
-		size_t offset = (*pos)%8; // the offset in bits (the loose bits at the end of the signature so far)
-		size_t data_loose_bits = ((dataBitLen+7)%8)+1; // valid bits in the last byte of the data
-		// iterate over bytes in data
-		int i;
-		unsigned char b;
-		unsigned char mask = (1<<offset)-1;
-		// all except for the last byte of the data string
-		for (i=0; i<(dataBitLen+7)/8 -1; i++) {
-			b = data[i];
-			// add to the bytes in the signature
-			sig[start_byte+i] = (sig[start_byte+i] & mask) | (b<<offset);
-			sig[start_byte+i+1] = b>>(8-offset);
-		}
-		// handle last byte separately
-		b = data[i];
-		b &= (1<<data_loose_bits)-1; // mask last byte
-		sig[start_byte+i] = (sig[start_byte+i] & mask) | (b<<offset);
-		if (data_loose_bits+offset > 8) { // check if we need to start one more byte
-			sig[start_byte+i+1] = b>>(8-offset);
-		}
-
-		(*pos) += dataBitLen;
-		return true;
-	} else {
-		// does not fit into the signature anymore
-		return false;
-	}
+	return NULL;
 }
 
-// This method generates a signature on a given message.
-int sign(const Params* p, const unsigned char* sk, const unsigned char* message, size_t messageByteLen, unsigned char* sig)
+// Sets up a pool of presignatures and starts its workers.
+int presig_pool_init(const SignCtx* ctx, size_t lowWatermark, size_t highWatermark, size_t numWorkers, PresigPool* pool)
 {
-	// detect failures, e.g. generating randomness or evaluating SHAKE
-	bool fail = false;
+	pool->ctx = ctx;
+	pool->lowWatermark = lowWatermark;
+	pool->highWatermark = highWatermark;
+	pool->presigs = NULL;
+	pool->ready.cells = NULL;
+	pool->empty.cells = NULL;
+	atomic_init(&pool->readyCount, 0);
+	atomic_init(&pool->hits, 0);
+	atomic_init(&pool->misses, 0);
+	pool->workers = NULL;
+	pool->numWorkers = 0;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->refilling = true; // fill the pool right from the start
+	pool->stop = false;
+
+	if ((lowWatermark >= highWatermark) || (numWorkers == 0)) {
+		return -1;
+	}
 
-	// set up a Keccak hash instance and feed sk
-	Keccak_HashInstance hashInstance;
-	if (Keccak_HashInitialize_SHAKE256(&hashInstance) != SUCCESS) {
-		// the initialization was unsuccessful
+	// allocate the presignatures, all of them are used in the beginning
+	// the presignatures hold Keccak states, which must be aligned to 64 bytes
+	if (highWatermark > SIZE_MAX / sizeof(Presig)) {
 		return -1;
 	}
-	if (Keccak_HashUpdate(&hashInstance, sk, p->seedSkByteLen * 8) != SUCCESS) {
-		// the updating was unsuccessful
+	pool->presigs = (Presig*) ws_alloc(highWatermark * sizeof(Presig));
+	if (pool->presigs == NULL) {
 		return -1;
 	}
-	if (Keccak_HashFinal(&hashInstance, NULL) != SUCCESS) {
-		// the finalization was unsuccessful
+	for (size_t i=0; i<highWatermark; i++) {
+		if (presig_init(&ctx->p, &pool->presigs[i]) != 0) {
+			return -1;
+		}
+	}
+	if ((presig_queue_init(&pool->ready, highWatermark) != 0) || (presig_queue_init(&pool->empty, highWatermark) != 0)) {
 		return -1;
 	}
+	for (size_t i=0; i<highWatermark; i++) {
+		presig_queue_push(&pool->empty, i);
+	}
 
-	// expand the secret seed to generate the seed for H
-	unsigned char* seedH = calloc(p->seedHByteLen, sizeof(unsigned char*));
-	if (Keccak_HashSqueeze(&hashInstance, seedH, p->seedHByteLen * 8) != SUCCESS) {
-		// something went wrong in the evaluation of the hash function
+	// start the workers
+	pool->workers = (pthread_t*) calloc(numWorkers, sizeof(pthread_t));
+	if (pool->workers == NULL) {
 		return -1;
 	}
-
-	// allocate memory for H
-	unsigned char** H = calloc(p->r, sizeof(unsigned char*));
-	// expand the seed to obtain H
-	unsigned char* tempH = calloc(p->n_in_bytes * p->r, sizeof(unsigned char));
-	if (SHAKE256(tempH, p->n_in_bytes * p->r, seedH, p->seedHByteLen) != 0) { fail = true; };
-	for (int i=0; i<p->r; i++) {
-		H[i] = calloc(p->n_in_bytes, sizeof(unsigned char));
-		memcpy(H[i], tempH+i*p->n_in_bytes, p->n_in_bytes);
-		// make sure the invalid bits are zero
-		H[i][(p->n_in_bytes -1)] &= (unsigned char) ((1<<(((p->n+7)%8)+1))-1); // mask the last block
-	}
-	free(tempH);
-	free(seedH);
-
-	// recompute the low-weight secret
-	unsigned char* priv = calloc(p->n_in_bytes, sizeof(unsigned char*));
-	size_t current_weight = 0;
-	for (int i=0; i<p->n; i++) {
-		size_t t = 0;
-		if (get_rand_uint(p->n - i, &t, &hashInstance) != 0) {
-			// something went wrong during the generation of the random number
+	for (size_t i=0; i<numWorkers; i++) {
+		if (pthread_create(&pool->workers[i], NULL, presig_pool_worker, pool) != 0) {
 			return -1;
 		}
-		if (t < (p->w - current_weight)) {
-			// set bit to 1
-			priv[i/8] = (priv[i/8] & (~(1<<(i%8)))) | (1<<(i%8));
-			current_weight++;
-		} else {
-			// set bit to 0
-			priv[i/8] = (priv[i/8] & (~(1<<(i%8))));
-		}
+		pool->numWorkers++;
 	}
 
-	// current position in the signature, in bits
-	size_t pos = 0;
-
-	// allocate memory
-	unsigned char** seedPerm = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** seedY = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** y = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** k0 = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** k1 = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** k2 = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** com0 = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** com1 = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** com2 = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
+	// successful execution
+	return 0;
+}
 
-	for (int i=0; i<p->t; i++) {
-		seedPerm[i] = (unsigned char*) calloc(p->seedPermByteLen, sizeof(unsigned char));
-		seedY[i] = (unsigned char*) calloc(p->seedYByteLen, sizeof(unsigned char));
-		y[i] = (unsigned char*) calloc(p->n_in_bytes, sizeof(unsigned char));
-		k0[i] = (unsigned char*) calloc(p->coinsCommByteLen, sizeof(unsigned char));
-		k1[i] = (unsigned char*) calloc(p->coinsCommByteLen, sizeof(unsigned char));
-		k2[i] = (unsigned char*) calloc(p->coinsCommByteLen, sizeof(unsigned char));
-		com0[i] = (unsigned char*) calloc(p->commByteLen, sizeof(unsigned char));
-		com1[i] = (unsigned char*) calloc(p->commByteLen, sizeof(unsigned char));
-		com2[i] = (unsigned char*) calloc(p->commByteLen, sizeof(unsigned char));
+// This method generates a signature on a given message, using a presignature from the pool if there is one.
+int sign_with_pool(PresigPool* pool, const unsigned char* message, size_t messageByteLen, unsigned char* sig)
+{
+	size_t index;
+	if (!presig_queue_pop(&pool->ready, &index)) {
+		// the pool is drained, sign from scratch
+		atomic_fetch_add(&pool->misses, 1);
+		presig_pool_refill(pool);
+		return sign_with_ctx(pool->ctx, message, messageByteLen, sig);
 	}
+	atomic_fetch_add(&pool->hits, 1);
+	size_t ready = atomic_fetch_sub(&pool->readyCount, 1) - 1;
 
-	unsigned char* chHash = (unsigned char*) calloc(p->chHashByteLen, sizeof(unsigned char));
-
-	unsigned char* challenges = (unsigned char*) calloc(p->t, sizeof(unsigned char));
-
-	// loop: try to generate a signature (failure due to signature too large)
-	bool success;
-	do {
-		success = true;
-
-		// zero signature
-		memset(sig, 0, p->sigByteLen);
-
-		// generate randomness and commitments
-		for (int i=0; i<p->t; i++) {
-			// get random permutation
-			if (get_randomness(seedPerm[i], p->seedPermByteLen) != 0) { fail = true; };
-			// sample random seed and generate y from the seed
-			if (get_randomness(seedY[i], p->seedYByteLen) != 0) { fail = true; };
-			if (SHAKE256(y[i], p->n_in_bytes, seedY[i], p->seedYByteLen) != 0) { fail = true; };
-			y[i][p->n_in_bytes-1] &= (unsigned char) ((1<<(((p->n+7)%8)+1))-1); // make sure the invalid bits are zero
-			// generate random coins
-			if (get_randomness(k0[i], p->coinsCommByteLen) != 0) { fail = true; };
-			if (get_randomness(k1[i], p->coinsCommByteLen) != 0) { fail = true; };
-			if (get_randomness(k2[i], p->coinsCommByteLen) != 0) { fail = true; };
-			// commit
-			// commitment 0
-			unsigned char* temp = (unsigned char*) calloc(p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen, sizeof(unsigned char));
-			memcpy(temp + p->r_in_bytes, seedPerm[i], p->seedPermByteLen); // permutation
-			memcpy(temp + p->r_in_bytes + p->seedPermByteLen, k0[i], p->coinsCommByteLen); // random coins
-			mult_H(p, H, y[i], temp); // H*y
-			if (SHAKE256(com0[i], p->commByteLen, temp, p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen) != 0) { fail = true; };
-			free(temp);
-			// commitment 1
-			temp = (unsigned char*) calloc(p->n_in_bytes + p->coinsCommByteLen, sizeof(unsigned char));
-			memcpy(temp + p->n_in_bytes, k1[i], p->coinsCommByteLen); // random coins
-			memcpy(temp, y[i], p->n_in_bytes);
-			if (apply_permutation(p, seedPerm[i], temp) != 0) { fail = true; }; // perm(y)
-			if (SHAKE256(com1[i], p->commByteLen, temp, p->n_in_bytes + p->coinsCommByteLen) != 0) { fail = true; };
-			// commitment 2
-			memcpy(temp + p->n_in_bytes, k2[i], p->coinsCommByteLen); // random coins
-			add_in_F2n(p, y[i], priv, temp);
-			if (apply_permutation(p, seedPerm[i], temp) != 0) { fail = true; }; // perm(y+priv)
-			if (SHAKE256(com2[i], p->commByteLen, temp, p->n_in_bytes + p->coinsCommByteLen) != 0) { fail = true; };
-			free(temp);
-		}
-
-		// get challenge
-		unsigned char* temp = (unsigned char*) calloc(p->t * p->commByteLen * 3 + messageByteLen, sizeof(unsigned char));
-		for (int i=0; i<p->t; i++) {
-			memcpy(temp + i * p->commByteLen * 3, com0[i], p->commByteLen);
-			memcpy(temp + i * p->commByteLen * 3 + p->commByteLen, com1[i], p->commByteLen);
-			memcpy(temp + i * p->commByteLen * 3 + p->commByteLen * 2, com2[i], p->commByteLen);
-		}
-		memcpy(temp + p->t * p->commByteLen * 3, message, messageByteLen);
-		// compute a hash of the complete challenge
-		if (SHAKE256(chHash, p->chHashByteLen, temp, p->t * p->commByteLen * 3 + messageByteLen) != 0) { fail = true; };
-		free(temp);
-		// include this hash in the signature
-		if (!include_in_signature(p, sig, &pos, chHash, p->chHashByteLen*8)) { success = false; }
-		// interpret as single ternary challenges
-		if (get_challenges(p, chHash, challenges) != 0) { fail = true; }; // every byte in "challenge" is a ternary challenge
-
-		// include one commitment per round in the signature
-		for (int i=0; i<p->t; i++) {
-			if (challenges[i] == 0) {
-				if (!include_in_signature(p, sig, &pos, com2[i], p->commByteLen*8)) { success = false; }
-			} else if (challenges[i] == 1) {
-				if (!include_in_signature(p, sig, &pos, com1[i], p->commByteLen*8)) { success = false; }
-			} else { // challenges[i] == 2
-				if (!include_in_signature(p, sig, &pos, com0[i], p->commByteLen*8)) { success = false; }
-			}
-		}
-
-		// generate response and signature
-		for (int i=0; i<p->t; i++) {
-			//printf("%d\n", i);
-
-			if (challenges[i] == 0) {
-				// include the random coins used in two of the initial commitments
-				if (!include_in_signature(p, sig, &pos, k0[i], p->coinsCommByteLen*8)) { success = false; }
-				if (!include_in_signature(p, sig, &pos, k1[i], p->coinsCommByteLen*8)) { success = false; }
-				// include the seed of y
-				if (!include_in_signature(p, sig, &pos, seedY[i], p->seedYByteLen*8)) { success = false; }
-				// include the seed of the permutation
-				if (!include_in_signature(p, sig, &pos, seedPerm[i], p->seedPermByteLen*8)) { success = false; }
-			} else if (challenges[i] == 1) {
-				// include the random coins used in two of the initial commitments
-				if (!include_in_signature(p, sig, &pos, k0[i], p->coinsCommByteLen*8)) { success = false; }
-				if (!include_in_signature(p, sig, &pos, k2[i], p->coinsCommByteLen*8)) { success = false; }
-				// include y+priv
-				unsigned char* temp_n = (unsigned char*) calloc(p->n_in_bytes, sizeof(unsigned char));
-				add_in_F2n(p, y[i], priv, temp_n); // y+priv
-				if (!include_in_signature(p, sig, &pos, temp_n, p->n)) { success = false; }
-				free(temp_n);
-				// include the seed of the permutation
-				if (!include_in_signature(p, sig, &pos, seedPerm[i], p->seedPermByteLen*8)) { success = false; }
-			} else { // challenges[i] == 2
-				// include the random coins used in two of the initial commitments
-				if (!include_in_signature(p, sig, &pos, k1[i], p->coinsCommByteLen*8)) { success = false; }
-				if (!include_in_signature(p, sig, &pos, k2[i], p->coinsCommByteLen*8)) { success = false; }
-				// include perm(y)
-				unsigned char* temp_n = (unsigned char*) calloc(p->n_in_bytes, sizeof(unsigned char));
-				memcpy(temp_n, y[i], p->n_in_bytes * sizeof(unsigned char));
-				if (apply_permutation(p, seedPerm[i], temp_n) != 0) { fail = true; }; // perm(y)
-				if (!include_in_signature(p, sig, &pos, temp_n, p->n)) { success = false; }
-				// include perm(priv)
-				memcpy(temp_n, priv, p->n_in_bytes * sizeof(unsigned char));
-				if (apply_permutation(p, seedPerm[i], temp_n) != 0) { fail = true; }; // perm(priv)
-				if (!include_in_signature(p, sig, &pos, temp_n, p->n)) { success = false; }
-				free(temp_n);
-			}
-		}
-
-	} while (!success);
+	// the index is owned by this thread until it is handed back
+	int res = sign_with_presig(pool->ctx, &pool->presigs[index], message, messageByteLen, sig);
+	presig_queue_push(&pool->empty, index);
 
-	// free memory
-	for (int i=0; i<p->t; i++) {
-		free(seedPerm[i]);
-		free(seedY[i]);
-		free(y[i]);
-		free(k0[i]);
-		free(k1[i]);
-		free(k2[i]);
-		free(com0[i]);
-		free(com1[i]);
-		free(com2[i]);
+	if (ready <= pool->lowWatermark) {
+		presig_pool_refill(pool);
 	}
 
-	free(seedPerm);
-	free(seedY);
-	free(y);
-	free(k0);
-	free(k1);
-	free(k2);
-	free(com0);
-	free(com1);
-	free(com2);
-
-	free(chHash);
+	return res;
+}
 
-	free(challenges);
+// Reads the counters of the pool.
+void presig_pool_stats(PresigPool* pool, size_t* hits, size_t* misses, size_t* ready)
+{
+	*hits = atomic_load(&pool->hits);
+	*misses = atomic_load(&pool->misses);
+	*ready = atomic_load(&pool->readyCount);
+}
 
-	for (int i=0; i<p->r; i++) {
-		free(H[i]);
+// Stops the workers and releases the pool, overwriting all presignatures.
+void presig_pool_free(PresigPool* pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+	for (size_t i=0; i<pool->numWorkers; i++) {
+		pthread_join(pool->workers[i], NULL);
 	}
-	free(H);
-
-	free(priv);
+	free(pool->workers);
+	pool->workers = NULL;
 
-	// successful execution?
-	if (fail) {
-		return -1;
-	} else {
-		return 0;
+	if (pool->presigs != NULL) {
+		for (size_t i=0; i<pool->highWatermark; i++) {
+			presig_free(&pool->presigs[i]);
+		}
+		free(pool->presigs);
+		pool->presigs = NULL;
 	}
+	free(pool->ready.cells);
+	free(pool->empty.cells);
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->cond);
 }
 
 /* -------------------------------------------------- */
 /* Verification */
 
-// This method reads dataBitLen bits from sig and writes them to data.
-// returns one bit indicating whether the requested data exceeded the signature or not
-bool read_from_signature(const Params* p, const unsigned char* sig, size_t* pos, unsigned char* data, size_t dataBitLen)
-{
-	if (((*pos)+dataBitLen) <= (p->sigByteLen*8)) {
-		// still below the signature size
-
-		if (dataBitLen == 0) {
-			return true;
-		}
-
-		size_t start_byte = (*pos)/8; // the byte of the signature from which we will start reading
-		size_t offset = (*pos)%8; // the offset in bits (the loose bits at the end of the signature read so far)
-		size_t data_loose_bits = ((dataBitLen+7)%8)+1; // valid bits in the last byte of the data
-		// iterate over bytes in data
-		int i;
-		unsigned char b;
-		unsigned char mask = (1<<offset)-1;
-		// all except for the last byte of the data string
-		for (i=0; i<(dataBitLen+7)/8 -1; i++) {
-			// extract one byte from the signature
-			b = (sig[start_byte+i] & (~mask)) >> offset;
-			b = b | (sig[start_byte+i+1]<<(8-offset));
-			data[i] = b;
-		}
-		// handle last byte separately
-		b = (sig[start_byte+i] & (~mask)) >> offset;
-		if (data_loose_bits+offset > 8) { // check if we need to check one more byte from the signature (make sure the length of th signature is not exceeded)
-			b = b | (sig[start_byte+i+1]<<(8-offset));
-		}
-		b &= (1<<data_loose_bits)-1; // mask last byte
-		data[i] = b;
-
-		(*pos) += dataBitLen;
-		return true;
-	} else {
-		// the queried data exceeds the signature
-		return false;
-	}
-}
-
-// This method checks whether a signature for a given message is valid or not.
-int verify(const Params* p, const unsigned char* pk, const unsigned char* message, size_t messageByteLen, const unsigned char* sig, bool* accept)
+// Sets up a verification context for the public key pk.
+int verify_ctx_init(const Params* p, const unsigned char* pk, VerifyCtx* ctx)
 {
-	*accept = true;
-
-	// pointer to the actual public key
-	const unsigned char* pub = pk + p->seedHByteLen;
+	ctx->p = *p;
+	ctx->H.data = NULL;
+	ctx->numThreads = 1;
 
-	// detect failures, e.g. generating randomness or evaluating SHAKE
-	bool fail = false;
+	// copy the public key
+	ctx->pk = (unsigned char*) malloc(p->pkByteLen * sizeof(unsigned char));
+	if (ctx->pk == NULL) {
+		return -1;
+	}
+	memcpy(ctx->pk, pk, p->pkByteLen);
 
-	// allocate memory for H
-	unsigned char** H = calloc(p->r, sizeof(unsigned char*));
 	// expand the seed to obtain H
-	unsigned char* tempH = calloc(p->n_in_bytes * p->r, sizeof(unsigned char));
-	if (SHAKE256(tempH, p->n_in_bytes * p->r, pk, p->seedHByteLen) != 0) { fail = true; };
-	for (int i=0; i<p->r; i++) {
-		H[i] = calloc(p->n_in_bytes, sizeof(unsigned char));
-		memcpy(H[i], tempH+i*p->n_in_bytes, p->n_in_bytes);
-		// make sure the invalid bits are zero
-		H[i][(p->n_in_bytes -1)] &= (unsigned char) ((1<<(((p->n+7)%8)+1))-1); // mask the last block
+	return expand_H(p, pk, &ctx->H);
+}
+
+// Sets the number of threads used to verify the rounds.
+int verify_ctx_set_threads(VerifyCtx* ctx, size_t numThreads)
+{
+	if (numThreads == 0) {
+		return -1;
 	}
-	free(tempH);
+	ctx->numThreads = numThreads;
+	return 0;
+}
 
-	// current position in the signature, in bits
-	size_t pos = 0;
+// Releases a verification context.
+void verify_ctx_free(VerifyCtx* ctx)
+{
+	free(ctx->pk);
+	ctx->pk = NULL;
+	free_H(&ctx->H);
+}
 
-	// allocate memory
-	unsigned char** com0 = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** com1 = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
-	unsigned char** com2 = (unsigned char**) calloc(p->t, sizeof(unsigned char*));
+// The data shared by the threads verifying the rounds of one signature.
+// The arrays with one entry per round are used by the thread verifying that round, the ones with two entries per round
+// by the thread verifying the rounds begin,...,end-1 from entry 2*begin on.
+typedef struct {
+	// the signature
+	const unsigned char* sig;
+	// the challenge of each round
+	unsigned char* challenges;
+	// the position of the response of each round in the signature, in bits
+	size_t* respPos;
+	// the commitments of each round, the ones not contained in the signature are recomputed
+	unsigned char** com0;
+	unsigned char** com1;
+	unsigned char** com2;
+	// set to false for each round with an invalid response
+	bool* roundAccept;
+	// the following is used while recomputing the commitments (see verify_rounds):
+	// y or y+priv of the rounds with challenge 0 or 1, H times it, the seed of the permutation and the random coins k0
+	unsigned char** v;
+	unsigned char** Hv;
+	unsigned char** seedPerm;
+	unsigned char** k0;
+	// the round of v[j], and the input of commitment 1 or 2 containing perm(v[j])
+	size_t* vRound;
+	size_t* vInput;
+	// the seeds of y of the rounds with challenge 0, and where to store y
+	unsigned char** seedYData;
+	unsigned char** seedY;
+	unsigned char** yOut;
+	// the inputs and outputs of the hashes of commitments 1 and 2, two entries per round
+	unsigned char** in12;
+	unsigned char** out12;
+	// the inputs and outputs of the hashes of commitment 0
+	unsigned char** in0;
+	unsigned char** out0;
+} VerifyRounds;
+
+// The memory of one verification, laid out in a workspace (see verify_ws_init).
+typedef struct {
+	// the challenge hash value contained in the signature
+	unsigned char* chHash;
+	// the data shared by the threads verifying the rounds
+	VerifyRounds vr;
+	// the workspaces of the threads verifying the rounds, rounds_scratch_len(p) bytes each
+	unsigned char* rounds;
+	size_t numThreads;
+} VerifyScratch;
+
+// Lays out the memory of a verification on numThreads threads in the workspace.
+void verify_ws_init(const Params* p, size_t numThreads, VerifyScratch* scratch, Workspace* ws)
+{
+	size_t len0 = p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen; // input length of commitment 0
+	size_t len12 = p->n_in_bytes + p->coinsCommByteLen; // input length of commitments 1 and 2
+	VerifyRounds* vr = &scratch->vr;
+
+	scratch->chHash = (unsigned char*) ws_take(ws, p->chHashByteLen);
+	vr->sig = NULL;
+	vr->challenges = (unsigned char*) ws_take(ws, p->t);
+	vr->respPos = (size_t*) ws_take(ws, p->t * sizeof(size_t));
+	vr->com0 = ws_take_arrays(ws, p->t, p->commByteLen);
+	vr->com1 = ws_take_arrays(ws, p->t, p->commByteLen);
+	vr->com2 = ws_take_arrays(ws, p->t, p->commByteLen);
+	vr->roundAccept = (bool*) ws_take(ws, p->t * sizeof(bool));
+	vr->v = ws_take_arrays(ws, p->t, p->n_in_bytes);
+	vr->Hv = ws_take_arrays(ws, p->t, p->r_in_bytes);
+	vr->seedPerm = ws_take_arrays(ws, p->t, p->seedPermByteLen);
+	vr->k0 = ws_take_arrays(ws, p->t, p->coinsCommByteLen);
+	vr->vRound = (size_t*) ws_take(ws, p->t * sizeof(size_t));
+	vr->vInput = (size_t*) ws_take(ws, p->t * sizeof(size_t));
+	vr->seedYData = ws_take_arrays(ws, p->t, p->seedYByteLen);
+	vr->seedY = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	vr->yOut = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	vr->in12 = ws_take_arrays(ws, 2 * p->t, len12);
+	vr->out12 = (unsigned char**) ws_take(ws, 2 * p->t * sizeof(unsigned char*));
+	vr->in0 = ws_take_arrays(ws, p->t, len0);
+	vr->out0 = (unsigned char**) ws_take(ws, p->t * sizeof(unsigned char*));
+	scratch->rounds = (unsigned char*) ws_take(ws, numThreads * rounds_scratch_len(p));
+	scratch->numThreads = numThreads;
+}
 
-	for (int i=0; i<p->t; i++) {
-		com0[i] = (unsigned char*) calloc(p->commByteLen, sizeof(unsigned char));
-		com1[i] = (unsigned char*) calloc(p->commByteLen, sizeof(unsigned char));
-		com2[i] = (unsigned char*) calloc(p->commByteLen, sizeof(unsigned char));
+// Allocates the memory of a verification in one block and lays it out (see verify_ws_init).
+// returns the workspace, to be released with free(ws.base), its base is NULL if the allocation failed
+Workspace verify_ws_alloc(const Params* p, size_t numThreads, VerifyScratch* scratch)
+{
+	Workspace ws = { NULL, 0 };
+	verify_ws_init(p, numThreads, scratch, &ws);
+	ws.base = (unsigned char*) ws_alloc(ws.used);
+	if (ws.base != NULL) {
+		ws.used = 0;
+		verify_ws_init(p, numThreads, scratch, &ws);
 	}
+	return ws;
+}
 
-	unsigned char* chHash = (unsigned char*) calloc(p->chHashByteLen, sizeof(unsigned char));
+// Reads the responses of the rounds begin,...,end-1 and recomputes the commitments that are not contained in the signature.
+// Stops at the first invalid response. The responses are read first, then the commitments of all rounds read are
+// recomputed at once, with the permutations and hashes of up to SHAKE_MAX_LANES rounds at a time.
+// arg points to the verification context and data to the shared VerifyRounds, as required by run_rounds
+// returns 0 if successful and -1 otherwise
+int verify_rounds(const void* arg, void* data, unsigned char* scratch, size_t begin, size_t end)
+{
+	const VerifyCtx* ctx = (const VerifyCtx*) arg;
+	VerifyRounds* vr = (VerifyRounds*) data;
+	const Params* p = &ctx->p;
+	const ParityCheckMatrix* H = &ctx->H;
+	const unsigned char* sig = vr->sig;
+	const unsigned char* challenges = vr->challenges;
+	unsigned char** com0 = vr->com0;
+	unsigned char** com1 = vr->com1;
+	unsigned char** com2 = vr->com2;
 
-	unsigned char* challenges = (unsigned char*) calloc(p->t, sizeof(unsigned char));
+	// pointer to the actual public key
+	const unsigned char* pub = ctx->pk + p->seedHByteLen;
 
-	// get challenge hash and interpret as single challenges
-	if (!read_from_signature(p, sig, &pos, chHash, p->chHashByteLen*8)) { *accept = false; }
-	if (get_challenges(p, chHash, challenges) != 0) { fail = true; }; // every byte in "challenge" is a ternary challenge
+	// the scratch memory of this thread
+	RoundsScratch rs;
+	Workspace ws = { scratch, 0 };
+	rounds_scratch_init(p, &rs, &ws);
 
-	// extract one commitment per round from the signature
-	for (int i=0; i<p->t; i++) {
-		if (challenges[i] == 0) {
-			if (!read_from_signature(p, sig, &pos, com2[i], p->commByteLen*8)) { *accept = false; }
-		} else if (challenges[i] == 1) {
-			if (!read_from_signature(p, sig, &pos, com1[i], p->commByteLen*8)) { *accept = false; }
-		} else { // challenges[i] == 2
-			if (!read_from_signature(p, sig, &pos, com0[i], p->commByteLen*8)) { *accept = false; }
-		}
-	}
+	// detect failures, e.g. evaluating SHAKE
+	bool fail = false;
 
-	// verification
-	for (int i=0; (i<p->t) && (*accept); i++) {
+	size_t len0 = p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen; // input length of commitment 0
+	size_t len12 = p->n_in_bytes + p->coinsCommByteLen; // input length of commitments 1 and 2
+
+	// the rounds with challenge 0 or 1 need y or y+priv, respectively, to recompute commitment 0 and commitment 1 or 2
+	unsigned char** v = vr->v + begin; // y or y+priv
+	unsigned char** Hv = vr->Hv + begin;
+	unsigned char** seedPerm = vr->seedPerm + begin;
+	unsigned char** k0 = vr->k0 + begin;
+	size_t* vRound = vr->vRound + begin; // the round of v[j]
+	size_t* vInput = vr->vInput + begin; // the input of commitment 1 or 2 containing perm(v[j])
+	size_t nv = 0; // the number of rounds with challenge 0 or 1
+	// the rounds with challenge 0 need y expanded from its seed
+	unsigned char** seedYData = vr->seedYData + begin;
+	unsigned char** yOut = vr->yOut + begin;
+	unsigned char** seedY = vr->seedY + begin;
+	size_t ny = 0; // the number of rounds with challenge 0
+	// the inputs and outputs of the hashes of commitments 1 and 2, at most two per round
+	unsigned char** in12 = vr->in12 + 2 * begin;
+	unsigned char** out12 = vr->out12 + 2 * begin;
+	size_t n12 = 0; // the number of commitments 1 and 2 to recompute
+
+	// scratch buffer
+	unsigned char* permpriv = rs.vec;
+
+	for (size_t i=begin; (i<end) && !fail; i++) {
+		bool accept = true;
+		size_t pos = vr->respPos[i];
 		if (challenges[i] == 0) {
 			// extract random coins from signature
-			unsigned char* k0 = (unsigned char*) calloc(p->coinsCommByteLen, sizeof(unsigned char));
-			unsigned char* k1 = (unsigned char*) calloc(p->coinsCommByteLen, sizeof(unsigned char));
-			if (!read_from_signature(p, sig, &pos, k0, p->coinsCommByteLen*8)) { *accept = false; }
-			if (!read_from_signature(p, sig, &pos, k1, p->coinsCommByteLen*8)) { *accept = false; }
-			// extract seed of y from signature and compute y
-			unsigned char* seedY = (unsigned char*) calloc(p->seedYByteLen, sizeof(unsigned char));
-			unsigned char* y  = (unsigned char*) calloc(p->n_in_bytes, sizeof(unsigned char));
-			if (!read_from_signature(p, sig, &pos, seedY, p->seedYByteLen*8)) { *accept = false; }
-			if (SHAKE256(y, p->n_in_bytes, seedY, p->seedYByteLen) != 0) { fail = true; };
-			y[p->n_in_bytes-1] &= (unsigned char) ((1<<(((p->n+7)%8)+1))-1); // make sure the invalid bits are zero
+			bits_read(sig, &pos, k0[nv], p->coinsCommByteLen*8);
+			bits_read(sig, &pos, in12[n12] + p->n_in_bytes, p->coinsCommByteLen*8);
+			// extract seed of y from signature, y is computed later
+			seedY[ny] = seedYData[nv];
+			bits_read(sig, &pos, seedY[ny], p->seedYByteLen*8);
+			yOut[ny] = v[nv];
+			ny++;
 			// extract permutation seed from signature
-			unsigned char* seedPerm  = (unsigned char*) calloc(p->seedPermByteLen, sizeof(unsigned char));
-			if (!read_from_signature(p, sig, &pos, seedPerm, p->seedPermByteLen*8)) { *accept = false; }
-			// recompute commitment 0
-			unsigned char* temp = (unsigned char*) calloc(p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen, sizeof(unsigned char));
-			mult_H(p, H, y, temp);
-			memcpy(temp + p->r_in_bytes, seedPerm, p->seedPermByteLen);
-			memcpy(temp + p->r_in_bytes + p->seedPermByteLen, k0, p->coinsCommByteLen);
-			if (SHAKE256(com0[i], p->commByteLen, temp, p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen) != 0) { fail = true; };
-			free(temp);
-			// recompute commitment 1
-			temp = (unsigned char*) calloc(p->n_in_bytes + p->coinsCommByteLen, sizeof(unsigned char));
-			memcpy(temp, y, p->n_in_bytes);
-			if (apply_permutation(p, seedPerm, temp) != 0) { fail = true; };
-			memcpy(temp + p->n_in_bytes, k1, p->coinsCommByteLen);
-			if (SHAKE256(com1[i], p->commByteLen, temp, p->n_in_bytes + p->coinsCommByteLen) != 0) { fail = true; };
-			free(temp);
-			// free
-			free(k0);
-			free(k1);
-			free(seedY);
-			free(y);
-			free(seedPerm);
+			bits_read(sig, &pos, seedPerm[nv], p->seedPermByteLen*8);
+			// commitment 1 is recomputed later, from perm(y) and k1
+			out12[n12] = com1[i];
+			vInput[nv] = n12;
+			n12++;
+			// commitment 0 is recomputed later
+			vRound[nv] = i;
+			nv++;
 		} else if (challenges[i] == 1) {
 			// extract random coins from signature
-			unsigned char* k0 = (unsigned char*) calloc(p->coinsCommByteLen, sizeof(unsigned char));
-			unsigned char* k2 = (unsigned char*) calloc(p->coinsCommByteLen, sizeof(unsigned char));
-			if (!read_from_signature(p, sig, &pos, k0, p->coinsCommByteLen*8)) { *accept = false; }
-			if (!read_from_signature(p, sig, &pos, k2, p->coinsCommByteLen*8)) { *accept = false; }
+			bits_read(sig, &pos, k0[nv], p->coinsCommByteLen*8);
+			bits_read(sig, &pos, in12[n12] + p->n_in_bytes, p->coinsCommByteLen*8);
 			// extract y + s from signature
-			unsigned char* ys  = (unsigned char*) calloc(p->n_in_bytes, sizeof(unsigned char));
-			if (!read_from_signature(p, sig, &pos, ys, p->n)) { *accept = false; }
+			bits_read(sig, &pos, v[nv], p->n);
 			// extract permutation seed from signature
-			unsigned char* seedPerm  = (unsigned char*) calloc(p->seedPermByteLen, sizeof(unsigned char));
-			if (!read_from_signature(p, sig, &pos, seedPerm, p->seedPermByteLen*8)) { *accept = false; }
-			// recompute commitment 0
-			unsigned char* temp = (unsigned char*) calloc(p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen, sizeof(unsigned char));
-			unsigned char* temp2 = (unsigned char*) calloc(p->r_in_bytes, sizeof(unsigned char));
-			mult_H(p, H, ys, temp2);
-			add_in_F2r(p, temp2, pub, temp);
-			free(temp2);
-			memcpy(temp + p->r_in_bytes, seedPerm, p->seedPermByteLen);
-			memcpy(temp + p->r_in_bytes + p->seedPermByteLen, k0, p->coinsCommByteLen);
-			if (SHAKE256(com0[i], p->commByteLen, temp, p->r_in_bytes + p->seedPermByteLen + p->coinsCommByteLen) != 0) { fail = true; };
-			free(temp);
-			// recompute commitment 2
-			temp = (unsigned char*) calloc(p->n_in_bytes + p->coinsCommByteLen, sizeof(unsigned char));
-			memcpy(temp, ys, p->n_in_bytes);
-			if (apply_permutation(p, seedPerm, temp) != 0) { fail = true; };
-			memcpy(temp + p->n_in_bytes, k2, p->coinsCommByteLen);
-			if (SHAKE256(com2[i], p->commByteLen, temp, p->n_in_bytes + p->coinsCommByteLen) != 0) { fail = true; };
-			free(temp);
-			// free
-			free(k0);
-			free(k2);
-			free(ys);
-			free(seedPerm);
+			bits_read(sig, &pos, seedPerm[nv], p->seedPermByteLen*8);
+			// commitment 2 is recomputed later, from perm(y+s) and k2
+			out12[n12] = com2[i];
+			vInput[nv] = n12;
+			n12++;
+			// commitment 0 is recomputed later
+			vRound[nv] = i;
+			nv++;
 		} else { // challenges[i] == 2
+			unsigned char* temp1 = in12[n12];
+			unsigned char* temp2 = in12[n12+1];
 			// extract random coins from signature
-			unsigned char* k1 = (unsigned char*) calloc(p->coinsCommByteLen, sizeof(unsigned char));
-			unsigned char* k2 = (unsigned char*) calloc(p->coinsCommByteLen, sizeof(unsigned char));
-			if (!read_from_signature(p, sig, &pos, k1, p->coinsCommByteLen*8)) { *accept = false; }
-			if (!read_from_signature(p, sig, &pos, k2, p->coinsCommByteLen*8)) { *accept = false; }
+			bits_read(sig, &pos, temp1 + p->n_in_bytes, p->coinsCommByteLen*8);
+			bits_read(sig, &pos, temp2 + p->n_in_bytes, p->coinsCommByteLen*8);
 			// extract perm(y) from signature
-			unsigned char* permy  = (unsigned char*) calloc(p->n_in_bytes, sizeof(unsigned char));
-			if (!read_from_signature(p, sig, &pos, permy, p->n)) { *accept = false; }
+			bits_read(sig, &pos, temp1, p->n);
 			// extract perm(priv) from signature
-			unsigned char* permpriv  = (unsigned char*) calloc(p->n_in_bytes, sizeof(unsigned char));
-			if (!read_from_signature(p, sig, &pos, permpriv, p->n)) { *accept = false; }
-			// recompute commitment 1
-			unsigned char* temp = (unsigned char*) calloc(p->n_in_bytes + p->coinsCommByteLen, sizeof(unsigned char));
-			memcpy(temp, permy, p->n_in_bytes);
-			memcpy(temp + p->n_in_bytes, k1, p->coinsCommByteLen);
-			if (SHAKE256(com1[i], p->commByteLen, temp, p->n_in_bytes + p->coinsCommByteLen) != 0) { fail = true; };
-			free(temp);
-			// recompute commitment 2
-			temp = (unsigned char*) calloc(p->n_in_bytes + p->coinsCommByteLen, sizeof(unsigned char));
-			add_in_F2n(p, permy, permpriv, temp);
-			memcpy(temp + p->n_in_bytes, k2, p->coinsCommByteLen);
-			if (SHAKE256(com2[i], p->commByteLen, temp, p->n_in_bytes + p->coinsCommByteLen) != 0) { fail = true; };
-			free(temp);
+			bits_read(sig, &pos, permpriv, p->n);
+			// commitments 1 and 2 are recomputed later, from perm(y) and k1, and perm(y)+perm(priv) and k2
+			add_in_F2n(p, temp1, permpriv, temp2);
+			out12[n12] = com1[i];
+			out12[n12+1] = com2[i];
+			n12 += 2;
 			// check Hamming weight of perm(priv) (==? p->w)
 			size_t wt = 0;
 			for (int j=0; j<p->n_in_bytes; j++) {
@@ -1031,69 +3457,201 @@ int verify(const Params* p, const unsigned char* pk, const unsigned char* messag
 				wt += Hamming_weight[c];
 			}
 			if (wt != p->w) {
-				*accept = false;
+				accept = false;
 			}
-			// free
-			free(k1);
-			free(k2);
-			free(permy);
-			free(permpriv);
 		}
+		if (!accept) {
+			vr->roundAccept[i] = false;
+			break;
+		}
+	}
+
+	// compute y for the rounds with challenge 0
+	if (shake256_many(yOut, p->n_in_bytes, (const unsigned char* const*) seedY, p->seedYByteLen, ny) != 0) { fail = true; };
+	for (size_t j=0; j<ny; j++) {
+		yOut[j][p->n_in_bytes-1] &= (unsigned char) ((1<<(((p->n+7)%8)+1))-1); // make sure the invalid bits are zero
+	}
+
+	// compute perm(y) or perm(y+s) for the rounds with challenge 0 or 1, the seeds of these permutations are public
+	Permutation* perms = rs.perms;
+	for (size_t c=0; (c<nv) && !fail; c+=SHAKE_MAX_LANES) {
+		size_t lanes = (nv - c < SHAKE_MAX_LANES) ? nv - c : SHAKE_MAX_LANES;
+		if (perm_generate_many(p, (const unsigned char* const*) (seedPerm + c), lanes, perms, 0, NULL, NULL) != 0) { fail = true; };
+		for (size_t k=0; k<lanes; k++) {
+			perm_apply(&perms[k], v[c+k], in12[vInput[c+k]]);
+		}
+	}
+
+	// recompute commitments 1 and 2
+	if (shake256_many(out12, p->commByteLen, (const unsigned char* const*) in12, len12, n12) != 0) { fail = true; };
+
+	// recompute commitment 0 for the rounds with challenge 0 or 1
+	if (mult_H_batch(p, H, (const unsigned char* const*) v, nv, Hv, &rs.multH) != 0) { fail = true; };
+	unsigned char** in0 = vr->in0 + begin;
+	unsigned char** out0 = vr->out0 + begin;
+	for (size_t j=0; j<nv; j++) {
+		size_t i = vRound[j];
+		out0[j] = com0[i];
+		if (challenges[i] == 0) {
+			memcpy(in0[j], Hv[j], p->r_in_bytes); // H*y
+		} else { // challenges[i] == 1
+			add_in_F2r(p, Hv[j], pub, in0[j]); // H*(y+s) + pub
+		}
+		memcpy(in0[j] + p->r_in_bytes, seedPerm[j], p->seedPermByteLen);
+		memcpy(in0[j] + p->r_in_bytes + p->seedPermByteLen, k0[j], p->coinsCommByteLen);
+	}
+	if (shake256_many(out0, p->commByteLen, (const unsigned char* const*) in0, len0, nv) != 0) { fail = true; };
+
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
 	}
+}
+
+// The message-independent part of the verification: checks the responses of all rounds and the zero padding of sig.
+// Writes the challenge hash value contained in sig to chHash and starts the recomputation of the challenge hash in hashInstance,
+// the message has to be absorbed afterwards. *accept is set to false if sig is rejected already.
+// The responses of the rounds are verified on scratch->numThreads threads.
+// returns 0 if successful and -1 otherwise
+int verify_commitments(const VerifyCtx* ctx, const unsigned char* sig, unsigned char* chHash, Keccak_HashInstance* hashInstance, bool* accept, VerifyScratch* scratch)
+{
+	const Params* p = &ctx->p;
+	VerifyRounds* vr = &scratch->vr;
+	unsigned char** com0 = vr->com0;
+	unsigned char** com1 = vr->com1;
+	unsigned char** com2 = vr->com2;
+	unsigned char* challenges = vr->challenges;
+
+	// detect failures, e.g. generating randomness or evaluating SHAKE
+	bool fail = false;
 
-	// recompute the challenge hash value
-	unsigned char* chHash_recomputed = (unsigned char*) calloc(p->chHashByteLen, sizeof(unsigned char));
-	unsigned char* temp = (unsigned char*) calloc(p->t * p->commByteLen * 3 + messageByteLen, sizeof(unsigned char));
+	// current position in the signature, in bits
+	size_t pos = 0;
+
+	// the commitments that are neither contained in the signature nor recomputed are zero
 	for (int i=0; i<p->t; i++) {
-		memcpy(temp + i * p->commByteLen * 3, com0[i], p->commByteLen);
-		memcpy(temp + i * p->commByteLen * 3 + p->commByteLen, com1[i], p->commByteLen);
-		memcpy(temp + i * p->commByteLen * 3 + p->commByteLen * 2, com2[i], p->commByteLen);
+		memset(com0[i], 0, p->commByteLen);
+		memset(com1[i], 0, p->commByteLen);
+		memset(com2[i], 0, p->commByteLen);
 	}
-	memcpy(temp + p->t * p->commByteLen * 3, message, messageByteLen);
-	if (SHAKE256(chHash_recomputed, p->chHashByteLen, temp, p->t * p->commByteLen * 3 + messageByteLen) != 0) { fail = true; };
-	free(temp);
 
-	// compare the challenge hash value of the signature with the hash of the commitments
-	if (memcmp(chHash, chHash_recomputed, p->chHashByteLen) != 0) {
+	// the challenge hash and one commitment per round come first, check once that they fit into the signature
+	if ((p->chHashByteLen + p->t * p->commByteLen) * 8 > p->sigByteLen*8) {
 		*accept = false;
+		memset(chHash, 0, p->chHashByteLen);
+	} else {
+		bits_read(sig, &pos, chHash, p->chHashByteLen*8);
 	}
-	free(chHash_recomputed);
+	// interpret the challenge hash as single challenges
+	if (get_challenges(p, chHash, challenges) != 0) { fail = true; }; // every byte in "challenge" is a ternary challenge
 
-	// check the zero padding (from the fixed-size modification)
-	// check loose bits (until the start of the next byte)
-	unsigned char b = 0;
-	read_from_signature(p, sig, &pos, &b, (8-(pos%8))%8);
-	if (b != 0) {
+	// extract one commitment per round from the signature
+	for (int i=0; (i<p->t) && *accept; i++) {
+		if (challenges[i] == 0) {
+			bits_read(sig, &pos, com2[i], p->commByteLen*8);
+		} else if (challenges[i] == 1) {
+			bits_read(sig, &pos, com1[i], p->commByteLen*8);
+		} else { // challenges[i] == 2
+			bits_read(sig, &pos, com0[i], p->commByteLen*8);
+		}
+	}
+
+	// the length of each response only depends on the challenge, hence the position of each response in the signature
+	// is known before any response is read, and the responses are read without further checks
+	size_t* respPos = vr->respPos;
+	for (int i=0; i<p->t; i++) {
+		respPos[i] = pos;
+		pos += response_bit_len(p, challenges[i]);
+	}
+	if (pos > p->sigByteLen*8) {
+		// the responses exceed the signature
 		*accept = false;
 	}
-	// check remaining full bytes
-	size_t remaining_bytes = p->sigByteLen - (pos/8);
-	if (remaining_bytes > 0) {
-		unsigned char* zeros = (unsigned char*) calloc(remaining_bytes, sizeof(unsigned char));
-		if (memcmp(zeros, sig + (pos/8), remaining_bytes) != 0) {
-			*accept = false;
+
+	// verification
+	if (*accept) {
+		for (int i=0; i<p->t; i++) {
+			vr->roundAccept[i] = true;
+		}
+		vr->sig = sig;
+		if (run_rounds(p, scratch->numThreads, verify_rounds, ctx, vr, scratch->rounds) != 0) { fail = true; };
+		for (int i=0; i<p->t; i++) {
+			if (!vr->roundAccept[i]) {
+				*accept = false;
+			}
 		}
 	}
 
-	// free memory
-	for (int i=0; i<p->t; i++) {
-		free(com0[i]);
-		free(com1[i]);
-		free(com2[i]);
+	// start recomputing the challenge hash value
+	if (challenge_hash_commitments(p, com0, com1, com2, hashInstance) != 0) { fail = true; };
+
+	// check the zero padding (from the fixed-size modification)
+	if (*accept) {
+		// check loose bits (until the start of the next byte)
+		unsigned char b = 0;
+		bits_read(sig, &pos, &b, (8-(pos%8))%8);
+		// check remaining full bytes
+		for (size_t j=pos/8; j<p->sigByteLen; j++) {
+			b |= sig[j];
+		}
+		if (b != 0) {
+			*accept = false;
+		}
 	}
 
-	free(com0);
-	free(com1);
-	free(com2);
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
 
-	free(chHash);
+// Completes the verification: compares the challenge hash value chHash of the signature with the challenge hash
+// recomputed in hashInstance, which has absorbed the commitments (see verify_commitments()) and the message.
+// *accept is set to false if they differ.
+// returns 0 if successful and -1 otherwise
+int verify_challenge(const Params* p, const unsigned char* chHash, Keccak_HashInstance* hashInstance, bool* accept)
+{
+	// detect failures evaluating SHAKE
+	bool fail = false;
 
-	free(challenges);
+	// recompute the challenge hash value and compare it with the one of the signature, a block at a time
+	unsigned char block[SHAKE256_RATE];
+	if (Keccak_HashFinal(hashInstance, NULL) != SUCCESS) { fail = true; };
+	for (size_t pos=0; (pos<p->chHashByteLen) && !fail; pos+=SHAKE256_RATE) {
+		size_t len = (p->chHashByteLen - pos < SHAKE256_RATE) ? p->chHashByteLen - pos : SHAKE256_RATE;
+		if (Keccak_HashSqueeze(hashInstance, block, len * 8) != SUCCESS) { fail = true; };
+		if (memcmp(chHash + pos, block, len) != 0) {
+			*accept = false;
+		}
+	}
 
-	for (int i=0; i<p->r; i++) {
-		free(H[i]);
+	// successful execution?
+	if (fail) {
+		return -1;
+	} else {
+		return 0;
 	}
-	free(H);
+}
+
+// Checks a signature with the memory laid out by verify_ws_init.
+// returns 0 if successful and -1 otherwise
+int verify_with_scratch(const VerifyCtx* ctx, const unsigned char* message, size_t messageByteLen, const unsigned char* sig, bool* accept, VerifyScratch* scratch)
+{
+	*accept = true;
+
+	const Params* p = &ctx->p;
+
+	// detect failures, e.g. evaluating SHAKE
+	bool fail = false;
+
+	Keccak_HashInstance hashInstance;
+	if (verify_commitments(ctx, sig, scratch->chHash, &hashInstance, accept, scratch) != 0) { fail = true; };
+	if (Keccak_HashUpdate(&hashInstance, message, messageByteLen * 8) != SUCCESS) { fail = true; };
+	if (verify_challenge(p, scratch->chHash, &hashInstance, accept) != 0) { fail = true; };
 
 	// successful execution?
 	if (fail) {
@@ -1103,3 +3661,117 @@ int verify(const Params* p, const unsigned char* pk, const unsigned char* messag
 	}
 }
 
+// This method checks whether a signature for a given message is valid or not, using the data in the verification context.
+int verify_with_ctx(const VerifyCtx* ctx, const unsigned char* message, size_t messageByteLen, const unsigned char* sig, bool* accept)
+{
+	VerifyScratch scratch;
+	Workspace ws = verify_ws_alloc(&ctx->p, ctx->numThreads, &scratch);
+	if (ws.base == NULL) {
+		*accept = false;
+		return -1;
+	}
+	int res = verify_with_scratch(ctx, message, messageByteLen, sig, accept, &scratch);
+	free(ws.base);
+	return res;
+}
+
+// The size of the workspace of verify_with_ctx_ws().
+size_t verify_workspace_size(const Params* p)
+{
+	VerifyScratch scratch;
+	Workspace ws = { NULL, 0 };
+	verify_ws_init(p, 1, &scratch, &ws);
+	return ws.used;
+}
+
+// This method checks whether a signature for a given message is valid or not, using the data in the verification context
+// and the workspace supplied by the caller.
+int verify_with_ctx_ws(const VerifyCtx* ctx, const unsigned char* message, size_t messageByteLen, const unsigned char* sig, bool* accept, void* workspace)
+{
+	// the workspace must be aligned to a cache line
+	if (((uintptr_t) workspace) % WS_ALIGNMENT != 0) {
+		*accept = false;
+		return -1;
+	}
+
+	// laid out in the workspace, on the calling thread only
+	VerifyScratch scratch;
+	Workspace ws = { (unsigned char*) workspace, 0 };
+	verify_ws_init(&ctx->p, 1, &scratch, &ws);
+	return verify_with_scratch(ctx, message, messageByteLen, sig, accept, &scratch);
+}
+
+// This method checks whether a signature for a given message is valid or not.
+int verify(const Params* p, const unsigned char* pk, const unsigned char* message, size_t messageByteLen, const unsigned char* sig, bool* accept)
+{
+	VerifyCtx ctx;
+	if (verify_ctx_init(p, pk, &ctx) != 0) {
+		verify_ctx_free(&ctx);
+		*accept = false;
+		return -1;
+	}
+	int res = verify_with_ctx(&ctx, message, messageByteLen, sig, accept);
+	verify_ctx_free(&ctx);
+	return res;
+}
+
+// Starts the verification of a signature on a message that is given in parts: verifies the responses of the rounds,
+// which do not depend on the message.
+int verify_init(const VerifyCtx* ctx, const unsigned char* sig, VerifyStream* stream)
+{
+	stream->ctx = ctx;
+	stream->accept = true;
+	stream->finished = false;
+	stream->chHash = (unsigned char*) calloc(ctx->p.chHashByteLen, sizeof(unsigned char));
+	VerifyScratch scratch;
+	Workspace ws = verify_ws_alloc(&ctx->p, ctx->numThreads, &scratch);
+	if ((stream->chHash == NULL) || (ws.base == NULL)) {
+		free(ws.base);
+		stream->finished = true;
+		return -1;
+	}
+	int res = verify_commitments(ctx, sig, stream->chHash, &stream->hashInstance, &stream->accept, &scratch);
+	free(ws.base);
+	if (res != 0) {
+		stream->finished = true;
+		return -1;
+	}
+	return 0;
+}
+
+// Absorbs the next part of the message into the recomputed challenge hash.
+int verify_update(VerifyStream* stream, const unsigned char* part, size_t partByteLen)
+{
+	// the verification must not be completed yet
+	if (stream->finished) {
+		return -1;
+	}
+	if (Keccak_HashUpdate(&stream->hashInstance, part, partByteLen * 8) != SUCCESS) {
+		return -1;
+	}
+	return 0;
+}
+
+// Completes the verification of a signature on the parts of the message absorbed by verify_update().
+int verify_final(VerifyStream* stream, bool* accept)
+{
+	*accept = false;
+	if (stream->finished) {
+		return -1;
+	}
+	stream->finished = true;
+
+	if (verify_challenge(&stream->ctx->p, stream->chHash, &stream->hashInstance, &stream->accept) != 0) {
+		return -1;
+	}
+	*accept = stream->accept;
+	return 0;
+}
+
+// Releases the data of a verification of a message given in parts.
+void verify_stream_free(VerifyStream* stream)
+{
+	free(stream->chHash);
+	stream->chHash = NULL;
+}
+
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <sys/wait.h>
 
 #include "sig.h"
 
@@ -128,6 +129,7 @@ bool test_sign_verify()
 	printf("r = \t%lu\t(codimension of the code)\n", p.r);
 	printf("w = \t%lu\t(weight of the secret)\n", p.w);
 	printf("t = \t%lu\t(number of parallel repetitions)\n", p.t);
+	printf("Keccak-p[1600] backend: %s\n", KeccakP1600_backend());
 
 	// allocate memory for H
 	unsigned char** H = calloc(p.r, sizeof(unsigned char*));
@@ -532,8 +534,1100 @@ bool test_corrupted_signatures()
 	return invalid_signatures == TEST_CORRUPTED_SIGNATURES_NMSG;
 }
 
-int main()
+// number of messages
+#define TEST_VERIFY_CTX_NMSG 20
+// length of each of the messages (in bytes)
+#define TEST_VERIFY_CTX_MSGBYTELEN 1000
+
+// Signs random messages and verifies the signatures with one verification context, also with corrupted messages.
+bool test_verify_ctx()
+{
+	printf("==================================================\n");
+	printf("Verification context\n");
+	printf("Signing and verifying %d random messages of length %d bytes.\n", TEST_VERIFY_CTX_NMSG, TEST_VERIFY_CTX_MSGBYTELEN);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+
+	// set up the verification context once
+	VerifyCtx ctx;
+	if (verify_ctx_init(&p, pk, &ctx) != 0) {
+		printf("Setting up the verification context failed.\n");
+		verify_ctx_free(&ctx);
+		free(sk);
+		free(pk);
+		return false;
+	}
+
+	// message
+	unsigned char message[TEST_VERIFY_CTX_MSGBYTELEN];
+
+	printf("|");
+	for (int i=0; i<TEST_VERIFY_CTX_NMSG; i++) {
+		printf("-");
+	}
+	printf("|\n|");
+	fflush(stdout);
+
+	int errors = 0;
+
+	for (int i=0; i<TEST_VERIFY_CTX_NMSG; i++) {
+		// get new random message
+		get_randomness(message, TEST_VERIFY_CTX_MSGBYTELEN); // fill with random data
+
+		// sign
+		unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+		sign(&p, sk, message, TEST_VERIFY_CTX_MSGBYTELEN, sig);
+
+		// verify, the signature must be accepted
+		bool accept;
+		verify_with_ctx(&ctx, message, TEST_VERIFY_CTX_MSGBYTELEN, sig, &accept);
+		if (!accept) {
+			errors++;
+		}
+
+		// corrupt the message, the signature must be rejected
+		message[i % TEST_VERIFY_CTX_MSGBYTELEN] ^= 0x01;
+		verify_with_ctx(&ctx, message, TEST_VERIFY_CTX_MSGBYTELEN, sig, &accept);
+		if (accept) {
+			errors++;
+		}
+
+		// clean up
+		free(sig);
+
+		printf("-");
+		fflush(stdout);
+	}
+	printf("|\n");
+
+	// clean up
+	verify_ctx_free(&ctx);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("Of %d messages, %d (%.1f%%) were verified correctly and there were %d (%.1f%%) errors.\n", TEST_VERIFY_CTX_NMSG, TEST_VERIFY_CTX_NMSG-errors, ((float)(TEST_VERIFY_CTX_NMSG-errors))*100/TEST_VERIFY_CTX_NMSG, errors, ((float)errors)*100/TEST_VERIFY_CTX_NMSG);
+
+	return errors == 0;
+}
+
+// number of messages
+#define TEST_SIGN_CTX_NMSG 20
+// length of each of the messages (in bytes)
+#define TEST_SIGN_CTX_MSGBYTELEN 1000
+
+// Signs random messages with one signing context and verifies the signatures.
+bool test_sign_ctx()
+{
+	printf("==================================================\n");
+	printf("Signing context\n");
+	printf("Signing and verifying %d random messages of length %d bytes.\n", TEST_SIGN_CTX_NMSG, TEST_SIGN_CTX_MSGBYTELEN);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+
+	// set up the signing context once
+	SignCtx ctx;
+	if (sign_ctx_init(&p, sk, &ctx) != 0) {
+		printf("Setting up the signing context failed.\n");
+		sign_ctx_free(&ctx);
+		free(sk);
+		free(pk);
+		return false;
+	}
+	printf("Secret data locked into RAM: %s.\n", ctx.locked ? "yes" : "no");
+
+	// message
+	unsigned char message[TEST_SIGN_CTX_MSGBYTELEN];
+
+	printf("|");
+	for (int i=0; i<TEST_SIGN_CTX_NMSG; i++) {
+		printf("-");
+	}
+	printf("|\n|");
+	fflush(stdout);
+
+	int invalid_signatures = 0;
+
+	for (int i=0; i<TEST_SIGN_CTX_NMSG; i++) {
+		// get new random message
+		get_randomness(message, TEST_SIGN_CTX_MSGBYTELEN); // fill with random data
+
+		// sign
+		unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+		sign_with_ctx(&ctx, message, TEST_SIGN_CTX_MSGBYTELEN, sig);
+
+		// verify
+		bool accept;
+		verify(&p, pk, message, TEST_SIGN_CTX_MSGBYTELEN, sig, &accept);
+		if (!accept) {
+			invalid_signatures++;
+		}
+
+		// clean up
+		free(sig);
+
+		printf("-");
+		fflush(stdout);
+	}
+	printf("|\n");
+
+	// clean up
+	sign_ctx_free(&ctx);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("Of %d messages, %d (%.1f%%) were signed and verified successfully and there were %d (%.1f%%) errors.\n", TEST_SIGN_CTX_NMSG, TEST_SIGN_CTX_NMSG-invalid_signatures, ((float)(TEST_SIGN_CTX_NMSG-invalid_signatures))*100/TEST_SIGN_CTX_NMSG, invalid_signatures, ((float)invalid_signatures)*100/TEST_SIGN_CTX_NMSG);
+
+	return invalid_signatures == 0;
+}
+
+// number of messages
+#define TEST_PRESIG_NMSG 20
+// length of each of the messages (in bytes)
+#define TEST_PRESIG_MSGBYTELEN 1000
+
+// Generates presignatures in advance, signs random messages with them and verifies the signatures.
+// Also checks that no presignature can be used twice.
+bool test_presig()
+{
+	printf("==================================================\n");
+	printf("Presignatures\n");
+	printf("Signing and verifying %d random messages of length %d bytes.\n", TEST_PRESIG_NMSG, TEST_PRESIG_MSGBYTELEN);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair and signing context
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+	SignCtx ctx;
+	sign_ctx_init(&p, sk, &ctx);
+
+	// generate all presignatures in advance
+	Presig presigs[TEST_PRESIG_NMSG];
+	for (int i=0; i<TEST_PRESIG_NMSG; i++) {
+		presig_init(&p, &presigs[i]);
+		presig_generate(&ctx, &presigs[i]);
+	}
+
+	// message
+	unsigned char message[TEST_PRESIG_MSGBYTELEN];
+
+	printf("|");
+	for (int i=0; i<TEST_PRESIG_NMSG; i++) {
+		printf("-");
+	}
+	printf("|\n|");
+	fflush(stdout);
+
+	int errors = 0;
+
+	for (int i=0; i<TEST_PRESIG_NMSG; i++) {
+		// get new random message
+		get_randomness(message, TEST_PRESIG_MSGBYTELEN); // fill with random data
+
+		// sign
+		unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+		if (sign_with_presig(&ctx, &presigs[i], message, TEST_PRESIG_MSGBYTELEN, sig) != 0) {
+			errors++;
+		}
+
+		// verify
+		bool accept;
+		verify(&p, pk, message, TEST_PRESIG_MSGBYTELEN, sig, &accept);
+		if (!accept) {
+			errors++;
+		}
+
+		// the presignature must not be accepted a second time
+		if (sign_with_presig(&ctx, &presigs[i], message, TEST_PRESIG_MSGBYTELEN, sig) == 0) {
+			errors++;
+		}
+
+		// clean up
+		free(sig);
+
+		printf("-");
+		fflush(stdout);
+	}
+	printf("|\n");
+
+	// clean up
+	for (int i=0; i<TEST_PRESIG_NMSG; i++) {
+		presig_free(&presigs[i]);
+	}
+	sign_ctx_free(&ctx);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("Of %d messages, %d (%.1f%%) were signed and verified successfully and there were %d (%.1f%%) errors.\n", TEST_PRESIG_NMSG, TEST_PRESIG_NMSG-errors, ((float)(TEST_PRESIG_NMSG-errors))*100/TEST_PRESIG_NMSG, errors, ((float)errors)*100/TEST_PRESIG_NMSG);
+
+	return errors == 0;
+}
+
+// number of messages
+#define TEST_PRESIG_POOL_NMSG 30
+// length of each of the messages (in bytes)
+#define TEST_PRESIG_POOL_MSGBYTELEN 1000
+// watermarks and number of workers of the pool
+#define TEST_PRESIG_POOL_LOW 2
+#define TEST_PRESIG_POOL_HIGH 8
+#define TEST_PRESIG_POOL_NWORKERS 2
+
+// Waits for a pool of presignatures to be filled, signs a burst of random messages with it and verifies the signatures.
+// Every signature must be counted either as a hit or as a miss of the pool.
+bool test_presig_pool()
+{
+	printf("==================================================\n");
+	printf("Pool of presignatures\n");
+	printf("Signing and verifying %d random messages of length %d bytes.\n", TEST_PRESIG_POOL_NMSG, TEST_PRESIG_POOL_MSGBYTELEN);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair, signing context and pool
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+	SignCtx ctx;
+	sign_ctx_init(&p, sk, &ctx);
+	PresigPool pool;
+	int errors = 0;
+	if (presig_pool_init(&ctx, TEST_PRESIG_POOL_LOW, TEST_PRESIG_POOL_HIGH, TEST_PRESIG_POOL_NWORKERS, &pool) != 0) {
+		errors++;
+	}
+	// the presignatures hold Keccak states, which the SIMD backends require to be aligned to 64 bytes
+	if (((uintptr_t) pool.presigs) % 64 != 0) {
+		errors++;
+	}
+
+	// wait for the pool to be filled (at most 10 seconds)
+	size_t hits, misses, ready;
+	for (int i=0; i<1000; i++) {
+		presig_pool_stats(&pool, &hits, &misses, &ready);
+		if (ready == TEST_PRESIG_POOL_HIGH) {
+			break;
+		}
+		usleep(10000);
+	}
+	if (ready != TEST_PRESIG_POOL_HIGH) {
+		errors++;
+	}
+
+	// message
+	unsigned char message[TEST_PRESIG_POOL_MSGBYTELEN];
+
+	printf("|");
+	for (int i=0; i<TEST_PRESIG_POOL_NMSG; i++) {
+		printf("-");
+	}
+	printf("|\n|");
+	fflush(stdout);
+
+	for (int i=0; i<TEST_PRESIG_POOL_NMSG; i++) {
+		// get new random message
+		get_randomness(message, TEST_PRESIG_POOL_MSGBYTELEN); // fill with random data
+
+		// sign
+		unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+		if (sign_with_pool(&pool, message, TEST_PRESIG_POOL_MSGBYTELEN, sig) != 0) {
+			errors++;
+		}
+
+		// verify
+		bool accept;
+		verify(&p, pk, message, TEST_PRESIG_POOL_MSGBYTELEN, sig, &accept);
+		if (!accept) {
+			errors++;
+		}
+
+		// clean up
+		free(sig);
+
+		printf("-");
+		fflush(stdout);
+	}
+	printf("|\n");
+
+	// every signature is counted once, and at least the presignatures available before the burst were used
+	presig_pool_stats(&pool, &hits, &misses, &ready);
+	if ((hits + misses != TEST_PRESIG_POOL_NMSG) || (hits < TEST_PRESIG_POOL_HIGH)) {
+		errors++;
+	}
+	printf("Pool hits: %zu, pool misses: %zu.\n", hits, misses);
+
+	// clean up
+	presig_pool_free(&pool);
+	sign_ctx_free(&ctx);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("Of %d messages, %d (%.1f%%) were signed and verified successfully and there were %d (%.1f%%) errors.\n", TEST_PRESIG_POOL_NMSG, TEST_PRESIG_POOL_NMSG-errors, ((float)(TEST_PRESIG_POOL_NMSG-errors))*100/TEST_PRESIG_POOL_NMSG, errors, ((float)errors)*100/TEST_PRESIG_POOL_NMSG);
+
+	return errors == 0;
+}
+
+// number of messages
+#define TEST_SIGN_THREADS_NMSG 20
+// length of each of the messages (in bytes)
+#define TEST_SIGN_THREADS_MSGBYTELEN 1000
+// the messages are signed with 1,2,...,TEST_SIGN_THREADS_MAX threads in turn
+#define TEST_SIGN_THREADS_MAX 4
+
+// Signs random messages with a varying number of threads and verifies the signatures.
+bool test_sign_threads()
+{
+	printf("==================================================\n");
+	printf("Parallel signing\n");
+	printf("Signing and verifying %d random messages of length %d bytes, using 1 to %d threads.\n", TEST_SIGN_THREADS_NMSG, TEST_SIGN_THREADS_MSGBYTELEN, TEST_SIGN_THREADS_MAX);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair and signing context
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+	SignCtx ctx;
+	sign_ctx_init(&p, sk, &ctx);
+
+	// message
+	unsigned char message[TEST_SIGN_THREADS_MSGBYTELEN];
+
+	printf("|");
+	for (int i=0; i<TEST_SIGN_THREADS_NMSG; i++) {
+		printf("-");
+	}
+	printf("|\n|");
+	fflush(stdout);
+
+	int errors = 0;
+
+	// zero threads are not allowed
+	if (sign_ctx_set_threads(&ctx, 0) == 0) {
+		errors++;
+	}
+
+	for (int i=0; i<TEST_SIGN_THREADS_NMSG; i++) {
+		// get new random message
+		get_randomness(message, TEST_SIGN_THREADS_MSGBYTELEN); // fill with random data
+
+		// sign
+		sign_ctx_set_threads(&ctx, 1 + i % TEST_SIGN_THREADS_MAX);
+		unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+		if (sign_with_ctx(&ctx, message, TEST_SIGN_THREADS_MSGBYTELEN, sig) != 0) {
+			errors++;
+		}
+
+		// verify
+		bool accept;
+		verify(&p, pk, message, TEST_SIGN_THREADS_MSGBYTELEN, sig, &accept);
+		if (!accept) {
+			errors++;
+		}
+
+		// clean up
+		free(sig);
+
+		printf("-");
+		fflush(stdout);
+	}
+	printf("|\n");
+
+	// clean up
+	sign_ctx_free(&ctx);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("Of %d messages, %d (%.1f%%) were signed and verified successfully and there were %d (%.1f%%) errors.\n", TEST_SIGN_THREADS_NMSG, TEST_SIGN_THREADS_NMSG-errors, ((float)(TEST_SIGN_THREADS_NMSG-errors))*100/TEST_SIGN_THREADS_NMSG, errors, ((float)errors)*100/TEST_SIGN_THREADS_NMSG);
+
+	return errors == 0;
+}
+
+// number of messages
+#define TEST_VERIFY_THREADS_NMSG 20
+// length of each of the messages (in bytes)
+#define TEST_VERIFY_THREADS_MSGBYTELEN 1000
+// the signatures are verified with 1,2,...,TEST_VERIFY_THREADS_MAX threads in turn
+#define TEST_VERIFY_THREADS_MAX 4
+
+// Verifies valid and corrupted signatures on random messages with a varying number of threads.
+bool test_verify_threads()
+{
+	printf("==================================================\n");
+	printf("Parallel verification\n");
+	printf("Verifying valid and corrupted signatures on %d random messages of length %d bytes, using 1 to %d threads.\n", TEST_VERIFY_THREADS_NMSG, TEST_VERIFY_THREADS_MSGBYTELEN, TEST_VERIFY_THREADS_MAX);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair and verification context
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+	VerifyCtx ctx;
+	verify_ctx_init(&p, pk, &ctx);
+
+	// message
+	unsigned char message[TEST_VERIFY_THREADS_MSGBYTELEN];
+
+	printf("|");
+	for (int i=0; i<TEST_VERIFY_THREADS_NMSG; i++) {
+		printf("-");
+	}
+	printf("|\n|");
+	fflush(stdout);
+
+	int errors = 0;
+
+	// zero threads are not allowed
+	if (verify_ctx_set_threads(&ctx, 0) == 0) {
+		errors++;
+	}
+
+	for (int i=0; i<TEST_VERIFY_THREADS_NMSG; i++) {
+		// get new random message
+		get_randomness(message, TEST_VERIFY_THREADS_MSGBYTELEN); // fill with random data
+
+		// sign
+		unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+		sign(&p, sk, message, TEST_VERIFY_THREADS_MSGBYTELEN, sig);
+
+		// verify
+		verify_ctx_set_threads(&ctx, 1 + i % TEST_VERIFY_THREADS_MAX);
+		bool accept;
+		verify_with_ctx(&ctx, message, TEST_VERIFY_THREADS_MSGBYTELEN, sig, &accept);
+		if (!accept) {
+			errors++;
+		}
+
+		// corrupt one random byte of the signature and verify again
+		size_t pos;
+		get_randomness((unsigned char*) &pos, sizeof(size_t));
+		sig[pos % p.sigByteLen] ^= 0x01;
+		verify_with_ctx(&ctx, message, TEST_VERIFY_THREADS_MSGBYTELEN, sig, &accept);
+		if (accept) {
+			errors++;
+		}
+
+		// clean up
+		free(sig);
+
+		printf("-");
+		fflush(stdout);
+	}
+	printf("|\n");
+
+	// clean up
+	verify_ctx_free(&ctx);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("Of %d messages, %d (%.1f%%) were verified correctly and there were %d (%.1f%%) errors.\n", TEST_VERIFY_THREADS_NMSG, TEST_VERIFY_THREADS_NMSG-errors, ((float)(TEST_VERIFY_THREADS_NMSG-errors))*100/TEST_VERIFY_THREADS_NMSG, errors, ((float)errors)*100/TEST_VERIFY_THREADS_NMSG);
+
+	return errors == 0;
+}
+
+// number of messages
+#define TEST_SIGN_STREAM_NMSG 20
+// length of each of the messages (in bytes)
+#define TEST_SIGN_STREAM_MSGBYTELEN 10000
+
+// Signs and verifies random messages that are fed in parts of random lengths, mixed with signing and verifying in one piece.
+// Also checks that a modified message is rejected and that a completed signature cannot be fed any more.
+bool test_sign_stream()
+{
+	printf("==================================================\n");
+	printf("Messages in parts\n");
+	printf("Signing and verifying %d random messages of length %d bytes in parts.\n", TEST_SIGN_STREAM_NMSG, TEST_SIGN_STREAM_MSGBYTELEN);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair and contexts
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+	SignCtx signCtx;
+	sign_ctx_init(&p, sk, &signCtx);
+	VerifyCtx verifyCtx;
+	verify_ctx_init(&p, pk, &verifyCtx);
+
+	// message
+	unsigned char message[TEST_SIGN_STREAM_MSGBYTELEN];
+
+	printf("|");
+	for (int i=0; i<TEST_SIGN_STREAM_NMSG; i++) {
+		printf("-");
+	}
+	printf("|\n|");
+	fflush(stdout);
+
+	int errors = 0;
+
+	for (int i=0; i<TEST_SIGN_STREAM_NMSG; i++) {
+		// get new random message
+		get_randomness(message, TEST_SIGN_STREAM_MSGBYTELEN); // fill with random data
+
+		// sign in parts of random lengths (including empty parts), starting before the message is known
+		unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+		SignStream signStream;
+		bool success = false;
+		if (sign_init(&signCtx, &signStream) != 0) {
+			errors++;
+		}
+		size_t fed = 0;
+		while (fed < TEST_SIGN_STREAM_MSGBYTELEN) {
+			unsigned char len;
+			get_randomness(&len, 1);
+			size_t partByteLen = len < TEST_SIGN_STREAM_MSGBYTELEN - fed ? len : TEST_SIGN_STREAM_MSGBYTELEN - fed;
+			if (sign_update(&signStream, message + fed, partByteLen) != 0) {
+				errors++;
+			}
+			fed += partByteLen;
+		}
+		if (sign_final(&signStream, sig, &success) != 0 || !success) {
+			errors++;
+		}
+		// the signature is completed
+		if (sign_update(&signStream, message, 1) == 0 || sign_final(&signStream, sig, &success) == 0) {
+			errors++;
+		}
+		sign_stream_free(&signStream);
+
+		// verify in one piece
+		bool accept;
+		verify_with_ctx(&verifyCtx, message, TEST_SIGN_STREAM_MSGBYTELEN, sig, &accept);
+		if (!accept) {
+			errors++;
+		}
+
+		// sign in one piece and verify in parts: the message in two halves, and with one byte modified
+		sign_with_ctx(&signCtx, message, TEST_SIGN_STREAM_MSGBYTELEN, sig);
+		for (int modified=0; modified<2; modified++) {
+			VerifyStream verifyStream;
+			if (verify_init(&verifyCtx, sig, &verifyStream) != 0) {
+				errors++;
+			}
+			message[i] ^= modified;
+			verify_update(&verifyStream, message, TEST_SIGN_STREAM_MSGBYTELEN / 2);
+			verify_update(&verifyStream, message + TEST_SIGN_STREAM_MSGBYTELEN / 2, TEST_SIGN_STREAM_MSGBYTELEN - TEST_SIGN_STREAM_MSGBYTELEN / 2);
+			message[i] ^= modified;
+			if (verify_final(&verifyStream, &accept) != 0 || accept != !modified) {
+				errors++;
+			}
+			// the verification is completed
+			if (verify_update(&verifyStream, message, 1) == 0 || verify_final(&verifyStream, &accept) == 0 || accept) {
+				errors++;
+			}
+			verify_stream_free(&verifyStream);
+		}
+
+		// clean up
+		free(sig);
+
+		printf("-");
+		fflush(stdout);
+	}
+	printf("|\n");
+
+	// clean up
+	sign_ctx_free(&signCtx);
+	verify_ctx_free(&verifyCtx);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("Of %d messages, %d (%.1f%%) were signed and verified correctly and there were %d (%.1f%%) errors.\n", TEST_SIGN_STREAM_NMSG, TEST_SIGN_STREAM_NMSG-errors, ((float)(TEST_SIGN_STREAM_NMSG-errors))*100/TEST_SIGN_STREAM_NMSG, errors, ((float)errors)*100/TEST_SIGN_STREAM_NMSG);
+
+	return errors == 0;
+}
+
+// number of messages
+#define TEST_SIGN_DETERMINISTIC_NMSG 20
+// length of each of the messages (in bytes)
+#define TEST_SIGN_DETERMINISTIC_MSGBYTELEN 1000
+// length of the additional input of hedged signatures (in bytes)
+#define TEST_SIGN_DETERMINISTIC_RNDBYTELEN 32
+
+// Signs random messages deterministically and hedged: the same inputs must give the same signature, also with several threads,
+// other inputs other signatures. Also checks that the signatures are accepted, and rejected for a modified message.
+bool test_sign_deterministic()
+{
+	printf("==================================================\n");
+	printf("Deterministic signatures\n");
+	printf("Signing %d random messages of length %d bytes deterministically and hedged, and verifying the signatures.\n", TEST_SIGN_DETERMINISTIC_NMSG, TEST_SIGN_DETERMINISTIC_MSGBYTELEN);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair and contexts, the second signing context of the same key uses several threads
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+	SignCtx signCtx;
+	sign_ctx_init(&p, sk, &signCtx);
+	SignCtx signCtxThreads;
+	sign_ctx_init(&p, sk, &signCtxThreads);
+	sign_ctx_set_threads(&signCtxThreads, 3);
+	VerifyCtx verifyCtx;
+	verify_ctx_init(&p, pk, &verifyCtx);
+
+	// message and additional input
+	unsigned char message[TEST_SIGN_DETERMINISTIC_MSGBYTELEN];
+	unsigned char rnd[TEST_SIGN_DETERMINISTIC_RNDBYTELEN];
+
+	// signatures
+	unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+	unsigned char* sig2 = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+	unsigned char* sigHedged = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+	unsigned char* sigPrev = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+
+	printf("|");
+	for (int i=0; i<TEST_SIGN_DETERMINISTIC_NMSG; i++) {
+		printf("-");
+	}
+	printf("|\n|");
+	fflush(stdout);
+
+	int errors = 0;
+
+	for (int i=0; i<TEST_SIGN_DETERMINISTIC_NMSG; i++) {
+		// get new random message and additional input
+		get_randomness(message, TEST_SIGN_DETERMINISTIC_MSGBYTELEN); // fill with random data
+		get_randomness(rnd, TEST_SIGN_DETERMINISTIC_RNDBYTELEN);
+
+		// the same signature twice, also with another context and several threads
+		if (sign_deterministic_with_ctx(&signCtx, message, TEST_SIGN_DETERMINISTIC_MSGBYTELEN, NULL, 0, sig) != 0) {
+			errors++;
+		}
+		sign_deterministic_with_ctx(&signCtxThreads, message, TEST_SIGN_DETERMINISTIC_MSGBYTELEN, NULL, 0, sig2);
+		if (memcmp(sig, sig2, p.sigByteLen) != 0) {
+			errors++;
+		}
+		// another message gives another signature
+		if ((i > 0) && (memcmp(sig, sigPrev, p.sigByteLen) == 0)) {
+			errors++;
+		}
+		memcpy(sigPrev, sig, p.sigByteLen);
+
+		// hedged: the same additional input gives the same signature, which is not the deterministic one
+		if (sign_deterministic_with_ctx(&signCtx, message, TEST_SIGN_DETERMINISTIC_MSGBYTELEN, rnd, TEST_SIGN_DETERMINISTIC_RNDBYTELEN, sigHedged) != 0) {
+			errors++;
+		}
+		sign_deterministic_with_ctx(&signCtxThreads, message, TEST_SIGN_DETERMINISTIC_MSGBYTELEN, rnd, TEST_SIGN_DETERMINISTIC_RNDBYTELEN, sig2);
+		if ((memcmp(sigHedged, sig2, p.sigByteLen) != 0) || (memcmp(sigHedged, sig, p.sigByteLen) == 0)) {
+			errors++;
+		}
+
+		// verify both signatures, and reject them for a modified message
+		bool accept;
+		verify_with_ctx(&verifyCtx, message, TEST_SIGN_DETERMINISTIC_MSGBYTELEN, sig, &accept);
+		if (!accept) {
+			errors++;
+		}
+		verify_with_ctx(&verifyCtx, message, TEST_SIGN_DETERMINISTIC_MSGBYTELEN, sigHedged, &accept);
+		if (!accept) {
+			errors++;
+		}
+		message[i] ^= 1;
+		verify_with_ctx(&verifyCtx, message, TEST_SIGN_DETERMINISTIC_MSGBYTELEN, sig, &accept);
+		if (accept) {
+			errors++;
+		}
+
+		printf("-");
+		fflush(stdout);
+	}
+	printf("|\n");
+
+	// clean up
+	free(sig);
+	free(sig2);
+	free(sigHedged);
+	free(sigPrev);
+	sign_ctx_free(&signCtx);
+	sign_ctx_free(&signCtxThreads);
+	verify_ctx_free(&verifyCtx);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("Of %d messages, %d (%.1f%%) were signed and verified correctly and there were %d (%.1f%%) errors.\n", TEST_SIGN_DETERMINISTIC_NMSG, TEST_SIGN_DETERMINISTIC_NMSG-errors, ((float)(TEST_SIGN_DETERMINISTIC_NMSG-errors))*100/TEST_SIGN_DETERMINISTIC_NMSG, errors, ((float)errors)*100/TEST_SIGN_DETERMINISTIC_NMSG);
+
+	return errors == 0;
+}
+
+// number of messages
+#define TEST_WORKSPACE_NMSG 20
+// length of each of the messages (in bytes)
+#define TEST_WORKSPACE_MSGBYTELEN 1000
+
+// Signs and verifies random messages in workspaces supplied by the caller, each reused for all messages,
+// mixed with signing and verifying with allocated memory. Also checks that a modified message is rejected
+// and that a workspace which is not aligned to a cache line is refused.
+bool test_workspace()
+{
+	printf("==================================================\n");
+	printf("Workspaces\n");
+	printf("Signing and verifying %d random messages of length %d bytes in workspaces supplied by the caller.\n", TEST_WORKSPACE_NMSG, TEST_WORKSPACE_MSGBYTELEN);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair and contexts
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+	SignCtx signCtx;
+	sign_ctx_init(&p, sk, &signCtx);
+	VerifyCtx verifyCtx;
+	verify_ctx_init(&p, pk, &verifyCtx);
+
+	// workspaces, with one more cache line to test a workspace that is not aligned
+	size_t signWsByteLen = sign_workspace_size(&p);
+	size_t verifyWsByteLen = verify_workspace_size(&p);
+	unsigned char* signWs = (unsigned char*) aligned_alloc(64, (signWsByteLen + 64 + 63) / 64 * 64);
+	unsigned char* verifyWs = (unsigned char*) aligned_alloc(64, (verifyWsByteLen + 64 + 63) / 64 * 64);
+	printf("Workspace sizes: %zu bytes (signing), %zu bytes (verification)\n", signWsByteLen, verifyWsByteLen);
+
+	// message
+	unsigned char message[TEST_WORKSPACE_MSGBYTELEN];
+
+	printf("|");
+	for (int i=0; i<TEST_WORKSPACE_NMSG; i++) {
+		printf("-");
+	}
+	printf("|\n|");
+	fflush(stdout);
+
+	int errors = 0;
+
+	for (int i=0; i<TEST_WORKSPACE_NMSG; i++) {
+		// get new random message
+		get_randomness(message, TEST_WORKSPACE_MSGBYTELEN); // fill with random data
+
+		// sign in the workspace, verify with and without a workspace
+		unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+		if (sign_with_ctx_ws(&signCtx, message, TEST_WORKSPACE_MSGBYTELEN, sig, signWs) != 0) {
+			errors++;
+		}
+		bool accept;
+		if (verify_with_ctx_ws(&verifyCtx, message, TEST_WORKSPACE_MSGBYTELEN, sig, &accept, verifyWs) != 0 || !accept) {
+			errors++;
+		}
+		verify_with_ctx(&verifyCtx, message, TEST_WORKSPACE_MSGBYTELEN, sig, &accept);
+		if (!accept) {
+			errors++;
+		}
+
+		// sign with allocated memory, verify in the workspace, also with one byte of the message modified
+		sign_with_ctx(&signCtx, message, TEST_WORKSPACE_MSGBYTELEN, sig);
+		for (int modified=0; modified<2; modified++) {
+			message[i] ^= modified;
+			if (verify_with_ctx_ws(&verifyCtx, message, TEST_WORKSPACE_MSGBYTELEN, sig, &accept, verifyWs) != 0 || accept != !modified) {
+				errors++;
+			}
+			message[i] ^= modified;
+		}
+
+		// workspaces that are not aligned
+		if (sign_with_ctx_ws(&signCtx, message, TEST_WORKSPACE_MSGBYTELEN, sig, signWs + 1) == 0) {
+			errors++;
+		}
+		if (verify_with_ctx_ws(&verifyCtx, message, TEST_WORKSPACE_MSGBYTELEN, sig, &accept, verifyWs + 1) == 0 || accept) {
+			errors++;
+		}
+
+		// clean up
+		free(sig);
+
+		printf("-");
+		fflush(stdout);
+	}
+	printf("|\n");
+
+	// clean up
+	free(signWs);
+	free(verifyWs);
+	sign_ctx_free(&signCtx);
+	verify_ctx_free(&verifyCtx);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("Of %d messages, %d (%.1f%%) were signed and verified correctly and there were %d (%.1f%%) errors.\n", TEST_WORKSPACE_NMSG, TEST_WORKSPACE_NMSG-errors, ((float)(TEST_WORKSPACE_NMSG-errors))*100/TEST_WORKSPACE_NMSG, errors, ((float)errors)*100/TEST_WORKSPACE_NMSG);
+
+	return errors == 0;
+}
+
+// number of messages per kernel level
+#define TEST_KERNELS_NMSG 10
+// length of each of the messages (in bytes)
+#define TEST_KERNELS_MSGBYTELEN 1000
+
+// names of the kernel levels
+const char* kernelNames[] = { "generic", "avx2", "avx512" };
+// kernel level selected on the command line, or the fastest one supported by the CPU
+KernelLevel kernelLevel;
+
+// Signs random messages deterministically with every kernel level supported by the CPU and checks that the signatures
+// do not depend on the kernels. Also signs with a pool of presignatures, whose workers run the Keccak backend of the level.
+bool test_kernels()
+{
+	printf("==================================================\n");
+	printf("Kernels\n");
+	printf("Signing and verifying %d random messages of length %d bytes with every kernel level.\n", TEST_KERNELS_NMSG, TEST_KERNELS_MSGBYTELEN);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	// generate keypair, messages and the signatures of the first level
+	unsigned char* sk = (unsigned char*) calloc(p.skByteLen, sizeof(unsigned char));
+	unsigned char* pk = (unsigned char*) calloc(p.pkByteLen, sizeof(unsigned char));
+	generate_keypair(&p, sk, pk);
+	unsigned char (*messages)[TEST_KERNELS_MSGBYTELEN] = calloc(TEST_KERNELS_NMSG, TEST_KERNELS_MSGBYTELEN);
+	get_randomness((unsigned char*) messages, TEST_KERNELS_NMSG * TEST_KERNELS_MSGBYTELEN);
+	unsigned char* sigs = (unsigned char*) calloc(TEST_KERNELS_NMSG * p.sigByteLen, sizeof(unsigned char));
+	unsigned char* sig = (unsigned char*) calloc(p.sigByteLen, sizeof(unsigned char));
+	bool first = true;
+
+	int errors = 0;
+
+	for (KernelLevel level=KERNELS_GENERIC; level<=KERNELS_AVX512; level++) {
+		printf("%-7s ", kernelNames[level]);
+		if (set_kernels(level) != 0) {
+			printf("not supported, skipped.\n");
+			continue;
+		}
+
+		// the contexts and the pool are set up for every level, see set_kernels()
+		SignCtx signCtx;
+		sign_ctx_init(&p, sk, &signCtx);
+		VerifyCtx verifyCtx;
+		verify_ctx_init(&p, pk, &verifyCtx);
+		PresigPool pool;
+		if (presig_pool_init(&signCtx, TEST_PRESIG_POOL_LOW, TEST_PRESIG_POOL_HIGH, TEST_PRESIG_POOL_NWORKERS, &pool) != 0) {
+			errors++;
+		}
+
+		printf("|");
+		for (int i=0; i<TEST_KERNELS_NMSG; i++) {
+			printf("-");
+		}
+		printf("|\n        |");
+		fflush(stdout);
+
+		for (int i=0; i<TEST_KERNELS_NMSG; i++) {
+			// sign deterministically, the signature must match the one of the first level
+			if (sign_deterministic_with_ctx(&signCtx, messages[i], TEST_KERNELS_MSGBYTELEN, NULL, 0, sig) != 0) {
+				errors++;
+			}
+			if (first) {
+				memcpy(sigs + i*p.sigByteLen, sig, p.sigByteLen);
+			} else if (memcmp(sigs + i*p.sigByteLen, sig, p.sigByteLen) != 0) {
+				errors++;
+			}
+			bool accept;
+			verify_with_ctx(&verifyCtx, messages[i], TEST_KERNELS_MSGBYTELEN, sig, &accept);
+			if (!accept) {
+				errors++;
+			}
+
+			// sign with the pool
+			if (sign_with_pool(&pool, messages[i], TEST_KERNELS_MSGBYTELEN, sig) != 0) {
+				errors++;
+			}
+			verify_with_ctx(&verifyCtx, messages[i], TEST_KERNELS_MSGBYTELEN, sig, &accept);
+			if (!accept) {
+				errors++;
+			}
+
+			printf("-");
+			fflush(stdout);
+		}
+		printf("|\n");
+		first = false;
+
+		// clean up
+		presig_pool_free(&pool);
+		sign_ctx_free(&signCtx);
+		verify_ctx_free(&verifyCtx);
+	}
+
+	// restore the kernels used by the other tests
+	if (set_kernels(kernelLevel) != 0) {
+		errors++;
+	}
+
+	// clean up
+	free(sig);
+	free(sigs);
+	free(messages);
+	free(sk);
+	free(pk);
+
+	// print results
+	printf("There were %d errors.\n", errors);
+
+	return errors == 0;
+}
+
+#ifdef PERMUTATIONS_USE_BENES
+// number of random permutations
+#define TEST_BENES_NPERMS 100
+
+// Applies random permutations as Beneš networks and by index, the results must be the same.
+bool test_benes()
+{
+	printf("==================================================\n");
+	printf("Beneš networks\n");
+	printf("Applying %d random permutations as Beneš networks and by index.\n", TEST_BENES_NPERMS);
+
+	// set up parameters
+	Params p;
+	INIT_PARAMS(&p);
+
+	int errors = 0;
+
+	size_t mismatches;
+	if (perm_compare_benes(&p, TEST_BENES_NPERMS, &mismatches) != 0) {
+		errors++;
+	} else {
+		errors += mismatches;
+	}
+
+	// print results
+	printf("There were %d errors.\n", errors);
+
+	return errors == 0;
+}
+#endif // PERMUTATIONS_USE_BENES
+
+// number of threads drawing from their randomness pools
+#define TEST_RANDOMNESS_NTHREADS 4
+// number of bytes drawn by every thread and process
+#define TEST_RANDOMNESS_BYTELEN 32
+
+// Draws randomness in a thread.
+void* test_randomness_thread(void* buf)
+{
+	if (get_randomness((unsigned char*) buf, TEST_RANDOMNESS_BYTELEN) != 0) {
+		memset(buf, 0, TEST_RANDOMNESS_BYTELEN);
+	}
+	return NULL;
+}
+
+// Checks that the randomness pools of different threads, and of a parent and a child process, produce different output.
+bool test_randomness()
+{
+	printf("==================================================\n");
+	printf("Randomness pools\n");
+	printf("Drawing %d bytes in each of %d threads, and in a parent and a child process.\n", TEST_RANDOMNESS_BYTELEN, TEST_RANDOMNESS_NTHREADS);
+
+	int errors = 0;
+
+	// one thread per pool, plus the main thread
+	unsigned char out[TEST_RANDOMNESS_NTHREADS+1][TEST_RANDOMNESS_BYTELEN];
+	pthread_t threads[TEST_RANDOMNESS_NTHREADS];
+	for (int i=0; i<TEST_RANDOMNESS_NTHREADS; i++) {
+		if (pthread_create(&threads[i], NULL, test_randomness_thread, out[i]) != 0) {
+			errors++;
+			memset(out[i], i, TEST_RANDOMNESS_BYTELEN);
+		}
+	}
+	test_randomness_thread(out[TEST_RANDOMNESS_NTHREADS]);
+	for (int i=0; i<TEST_RANDOMNESS_NTHREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	for (int i=0; i<=TEST_RANDOMNESS_NTHREADS; i++) {
+		for (int j=0; j<i; j++) {
+			if (memcmp(out[i], out[j], TEST_RANDOMNESS_BYTELEN) == 0) {
+				errors++;
+			}
+		}
+	}
+
+	// the child process must not repeat the output of the parent
+	int fds[2];
+	unsigned char parent[TEST_RANDOMNESS_BYTELEN];
+	unsigned char child[TEST_RANDOMNESS_BYTELEN];
+	if (pipe(fds) != 0) {
+		errors++;
+	} else {
+		pid_t pid = fork();
+		if (pid == 0) {
+			test_randomness_thread(child);
+			_exit(write(fds[1], child, TEST_RANDOMNESS_BYTELEN) == TEST_RANDOMNESS_BYTELEN ? 0 : 1);
+		}
+		test_randomness_thread(parent);
+		if ((pid < 0) || (read(fds[0], child, TEST_RANDOMNESS_BYTELEN) != TEST_RANDOMNESS_BYTELEN)) {
+			errors++;
+		} else if (memcmp(parent, child, TEST_RANDOMNESS_BYTELEN) == 0) {
+			errors++;
+		}
+		if (pid > 0) {
+			waitpid(pid, NULL, 0);
+		}
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	// print results
+	printf("There were %d errors.\n", errors);
+
+	return errors == 0;
+}
+
+int main(int argc, char** argv)
 {
+	// select the kernels, the fastest ones supported by the CPU unless a level is given
+	if (argc > 1) {
+		for (kernelLevel=KERNELS_GENERIC; kernelLevel<=KERNELS_AVX512; kernelLevel++) {
+			if (strcmp(argv[1], kernelNames[kernelLevel]) == 0) {
+				break;
+			}
+		}
+		if ((kernelLevel > KERNELS_AVX512) || (set_kernels(kernelLevel) != 0)) {
+			printf("Usage: %s [generic|avx2|avx512], the kernels must be supported by the CPU. Abort.\n", argv[0]);
+			return -1;
+		}
+	} else {
+		kernelLevel = KERNELS_AVX512;
+		while (set_kernels(kernelLevel) != 0) {
+			kernelLevel--;
+		}
+	}
+	printf("Kernels: %s\n", kernelNames[kernelLevel]);
+
 	// init the random pool
 	printf("Initializing the randomness pool... ");
 	if (rand_init() == 0) {
@@ -553,6 +1647,20 @@ int main()
 	tests_passed = tests_passed & test_corrupted_key();
 	tests_passed = tests_passed & test_corrupted_messages();
 	tests_passed = tests_passed & test_corrupted_signatures();
+	tests_passed = tests_passed & test_verify_ctx();
+	tests_passed = tests_passed & test_sign_ctx();
+	tests_passed = tests_passed & test_presig();
+	tests_passed = tests_passed & test_presig_pool();
+	tests_passed = tests_passed & test_sign_threads();
+	tests_passed = tests_passed & test_verify_threads();
+	tests_passed = tests_passed & test_sign_stream();
+	tests_passed = tests_passed & test_sign_deterministic();
+	tests_passed = tests_passed & test_workspace();
+	tests_passed = tests_passed & test_kernels();
+	tests_passed = tests_passed & test_randomness();
+#ifdef PERMUTATIONS_USE_BENES
+	tests_passed = tests_passed & test_benes();
+#endif // PERMUTATIONS_USE_BENES
 	printf("==================================================\n");
 	if (tests_passed) {
 		printf("All tests PASSED.\n");
@@ -15,28 +15,70 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <math.h>
 
 // Use the SHAKE-256 implementation from the Keccak Team, also see keccak.noekeon.org.
-#include "KeccakCodePackage-master/bin/generic64/libkeccak.a.headers/SimpleFIPS202.h"
-#include "KeccakCodePackage-master/bin/generic64/libkeccak.a.headers/KeccakHash.h"
+// The Makefile builds it on top of keccak-dispatch/, which selects the fastest Keccak-p[1600] backend at load time.
+#include "SimpleFIPS202.h"
+#include "KeccakHash.h"
 
 /**
   * If defined, use 64-bit integers in the application of the permutation, otherwise use 32-bit integers.
   */
 #define PERMUTATIONS_USE_64BIT
 
+/**
+  * If defined, a permutation is applied as a Beneš network on the packed vector, using control bits computed once
+  * when the permutation is generated. This makes each application cheaper, but computing the control bits costs more
+  * than generating the permutation itself, and signing and verification apply each permutation at most twice.
+  *
+  * Either way, the signature generation applies its secret permutations in constant time: the vectors are carried through
+  * the constant-time sorting network that generates the permutation. Only the verification, whose permutations are public,
+  * applies them afterwards (by index or as a Beneš network), which is not constant-time.
+  * "make benes" builds the tests with this option, they compare the Beneš networks against the application by index.
+  */
+//#define PERMUTATIONS_USE_BENES
+
+/**
+  * If defined, the low-weight secret is expanded from the secret key in constant time: a fixed amount of the expansion seeds
+  * a permutation, which moves a vector with leading ones through the constant-time sorting network (see perm_generate).
+  * Otherwise, it is sampled position by position, where only the rejected numbers show in the timing.
+  * Both yield a uniformly distributed secret, but a different one for the same secret key: keys are not compatible between both.
+  */
+//#define SAMPLE_SECRET_CONSTANT_TIME
+
+/**
+  * If defined, every signing attempt draws one master seed from the randomness pool and expands the seeds and random coins
+  * of all rounds from it with SHAKE256, in a few squeezes on parallel Keccak instances.
+  * Otherwise, every seed and every random coin is drawn from the randomness pool separately. The signature format is the same.
+  * Deterministic signatures (see sign_deterministic_with_ctx()) always expand the randomness from a master seed.
+  */
+#define SIGN_EXPAND_MASTER_SEED
+
+/**
+  * If defined, SIMD kernels (AVX2, AVX-512) are compiled in on x86-64 and selected at runtime, depending on the CPU.
+  * Otherwise, only the portable implementations are used.
+  */
+#define USE_X86_SIMD_KERNELS
+
 #ifndef NIST_API
 /**
   * Function to initialize the randomness pool. Needs to be called once in the beginning of the program.
+  * Every thread has its own randomness pool, seeded from the operating system on its first use.
+  * A pool is reseeded regularly and in a child process after fork(), so the child does not repeat the output of its parent.
   * @return	0 if successful, -1 otherwise
   */
 int rand_init();
 #endif // NIST_API
 
 /**
-  * Function to access the randomness pool.
+  * Function to access the randomness pool of the calling thread.
   * @param	buf		A pointer to the buffer where to write the output data.
   * @param	bufByteLen	The desired number of output bytes.
   * @pre	If NIST_API is not defined, rand_init() must have been called already.
@@ -45,6 +87,29 @@ int rand_init();
   */
 int get_randomness(unsigned char* buf, size_t bufByteLen);
 
+/**
+  * The instruction set extensions that the kernels and the Keccak-p[1600] backend may use, see set_kernels().
+  */
+typedef enum {
+	// the portable implementations only
+	KERNELS_GENERIC,
+	// up to AVX2
+	KERNELS_AVX2,
+	// up to AVX-512
+	KERNELS_AVX512
+} KernelLevel;
+
+/**
+  * Function to restrict the kernels and the Keccak-p[1600] backend to the instruction set extensions up to @a level,
+  * e.g. to test the AVX2 implementations on a CPU that supports AVX-512.
+  * When the program is loaded, the fastest implementations supported by the CPU are selected.
+  * @param	level	The instruction set extensions that may be used, they must be supported by the CPU.
+  * @pre	No other thread uses the library meanwhile, and there is no presignature, presignature pool, SignStream or VerifyStream:
+  * 		their Keccak states are laid out for the previous backend. The randomness pools of all threads are reseeded on their next use.
+  * @return	0 if successful, -1 if the CPU does not support @a level or the SIMD kernels are not compiled in
+  */
+int set_kernels(KernelLevel level);
+
 /**
   * A struct representing a complete parameter set.
   */
@@ -94,6 +159,196 @@ typedef struct {
 	size_t pkByteLen;
 } Params;
 
+/**
+  * A struct representing the parity-check matrix H, stored row by row in one contiguous block.
+  * Every row is padded to a multiple of 64 bytes and can be accessed in 64-bit words.
+  * All bits beyond the n valid bits of a row are zero.
+  */
+typedef struct {
+	// number of rows (equal to r)
+	size_t rows;
+	// number of 64-bit words holding the n valid bits of a row
+	size_t wordLen;
+	// number of 64-bit words per row, including the padding
+	size_t rowWordLen;
+	// the rows of H
+	uint64_t* data;
+} ParityCheckMatrix;
+
+/**
+  * A struct holding a public key together with the data expanded from it.
+  * It can be used to verify any number of signatures under the same public key.
+  */
+typedef struct {
+	// the parameter set
+	Params p;
+	// a copy of the public key
+	unsigned char* pk;
+	// the parity-check matrix, expanded from the seed in the public key
+	ParityCheckMatrix H;
+	// number of threads verifying the rounds, see verify_ctx_set_threads()
+	size_t numThreads;
+} VerifyCtx;
+
+/**
+  * A struct holding the data expanded from a secret key.
+  * It can be used to generate any number of signatures with the same secret key.
+  * The secret data is kept in memory that is locked into RAM if possible, and overwritten when the context is released.
+  */
+typedef struct {
+	// the parameter set
+	Params p;
+	// the parity-check matrix, expanded from the secret key
+	ParityCheckMatrix H;
+	// the low-weight secret (n bits)
+	unsigned char* priv;
+	// key of the deterministic signatures (seedSkByteLen bytes), derived from the secret key, see sign_deterministic_with_ctx()
+	unsigned char* seedDet;
+	// true if the memory holding H and the secret could be locked into RAM, see mlock()
+	bool locked;
+	// number of threads computing the commitments of the rounds, see sign_ctx_set_threads()
+	size_t numThreads;
+} SignCtx;
+
+/**
+  * A struct holding the scratch memory of the response phase of a signature generation.
+  */
+typedef struct {
+	// the challenge hash value and the challenges of all rounds
+	unsigned char* chHash;
+	unsigned char* challenges;
+	// a vector of n bits
+	unsigned char* temp_n;
+} RespondScratch;
+
+/**
+  * A struct holding a presignature, i.e. the message-independent part of a signature:
+  * the randomness and the commitments of all rounds.
+  * A presignature can be used for one signature only. It is kept in memory that is locked into RAM if possible.
+  * It holds a Keccak state, thus it must be aligned to 64 bytes (KeccakP1600_stateAlignment): the compiler aligns variables,
+  * dynamically allocated presignatures need aligned_alloc() or posix_memalign(), malloc() does not suffice.
+  */
+typedef struct {
+	// the parameter set
+	Params p;
+	// one block holding the data of all rounds and the scratch memory of the response phase
+	unsigned char* data;
+	// the size of the block (in bytes)
+	size_t dataByteLen;
+	// the data of each round, pointing into the block:
+	// seeds of the permutation and of y, the vector y, the random coins, perm(y) and perm(y+priv) and the commitments
+	unsigned char** seedPerm;
+	unsigned char** seedY;
+	// y, replaced by y+priv once the commitments are computed
+	unsigned char** y;
+	unsigned char** k0;
+	unsigned char** k1;
+	unsigned char** k2;
+	// perm(y) and perm(y+priv), directly followed by k1 and k2 respectively (the inputs of commitments 1 and 2)
+	unsigned char** permY;
+	unsigned char** permYpriv;
+	unsigned char** com0;
+	unsigned char** com1;
+	unsigned char** com2;
+	// the scratch memory of the response phase, at the end of the block, such that signing with the presignature allocates nothing
+	RespondScratch respond;
+	// the challenge hash after absorbing the commitments of all rounds, the message is absorbed when signing
+	Keccak_HashInstance chHashInstance;
+	// true if the presignature has been used already (or has not been generated yet)
+	bool used;
+	// true if the block could be locked into RAM, see mlock()
+	bool locked;
+} Presig;
+
+/**
+  * A cell of a PresigQueue.
+  */
+typedef struct {
+	// sequence number, determines if the cell can be written to or read from
+	atomic_size_t seq;
+	// the index of a presignature in the pool
+	size_t index;
+} PresigQueueCell;
+
+/**
+  * A bounded lock-free queue of presignature indices (multiple producers, multiple consumers).
+  * Every index that is taken out of the queue is owned exclusively by the taking thread.
+  */
+typedef struct {
+	// the cells, their number is a power of two
+	PresigQueueCell* cells;
+	// number of cells minus one
+	size_t mask;
+	// position of the next write
+	atomic_size_t tail;
+	// position of the next read
+	atomic_size_t head;
+} PresigQueue;
+
+/**
+  * A pool of presignatures, kept filled by worker threads in the background.
+  * Whenever the number of ready presignatures drops to the low watermark, the workers refill the pool up to the high watermark.
+  * Taking a presignature out of the pool is lock-free. If the pool is drained, a signature is generated from scratch.
+  */
+typedef struct {
+	// the signing context that all presignatures belong to
+	const SignCtx* ctx;
+	// refill if at most this many presignatures are ready
+	size_t lowWatermark;
+	// refill up to this many presignatures (the number of presignatures in the pool)
+	size_t highWatermark;
+	// the presignatures
+	Presig* presigs;
+	// indices of ready presignatures
+	PresigQueue ready;
+	// indices of used presignatures
+	PresigQueue empty;
+	// number of ready presignatures
+	atomic_size_t readyCount;
+	// number of signatures generated from a presignature of the pool
+	atomic_size_t hits;
+	// number of signatures generated from scratch because the pool was drained
+	atomic_size_t misses;
+	// the worker threads
+	pthread_t* workers;
+	size_t numWorkers;
+	// protects refilling and stop, and wakes the workers
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	// true while the workers are refilling the pool
+	bool refilling;
+	// true if the workers shall terminate
+	bool stop;
+} PresigPool;
+
+/**
+  * A struct holding a signature generation on a message that is given in several parts, see sign_init().
+  * It holds a Keccak state and must be aligned to 64 bytes, like a Presig.
+  */
+typedef struct {
+	// the signing context
+	const SignCtx* ctx;
+	// the commitments of the signature, presig.chHashInstance absorbs the parts of the message
+	Presig presig;
+} SignStream;
+
+/**
+  * A struct holding a verification of a signature on a message that is given in several parts, see verify_init().
+  * It holds a Keccak state and must be aligned to 64 bytes, like a Presig.
+  */
+typedef struct {
+	// the verification context
+	const VerifyCtx* ctx;
+	// the challenge hash value contained in the signature
+	unsigned char* chHash;
+	// the recomputed challenge hash, absorbs the parts of the message
+	Keccak_HashInstance hashInstance;
+	// false if the signature has been rejected already, independently of the message
+	bool accept;
+	// true if verify_final() has been called already (or verify_init() failed)
+	bool finished;
+} VerifyStream;
+
 /**
   * Function to initialize a parameter set.
   * These parameters guarantee 64-bit post-quantum security.
@@ -179,6 +434,210 @@ int generate_keypair(const Params* p, unsigned char* sk, unsigned char* pk);
   */
 int sign(const Params* p, const unsigned char* sk, const unsigned char* message, size_t messageByteLen, unsigned char* sig);
 
+/**
+  * Function to set up a signing context for a secret key.
+  * A failure to lock the memory (e.g. due to RLIMIT_MEMLOCK) is not treated as an error, but reported in @a ctx->locked.
+  * @param	p	A pointer to a parameter set.
+  * @param	sk	A pointer to the secret key.
+  * @param	ctx	A pointer to the context to be initialized.
+  * @post	@a ctx must be released with sign_ctx_free(), also if the initialization failed.
+  * @return	0 if successful, -1 otherwise
+  */
+int sign_ctx_init(const Params* p, const unsigned char* sk, SignCtx* ctx);
+
+/**
+  * Function to generate a signature, using a signing context.
+  * The context is not modified.
+  * @param	ctx		A pointer to a context set up by sign_ctx_init().
+  * @param	message		A pointer to the message to be signed.
+  * @param	messageByteLen	The length of the message, in bytes.
+  * @param	sig		A pointer to a buffer where to store the signature.
+  * @pre	If NIST_API is not defined, rand_init() must have been called already.
+  * @pre	At @a sig, there are at least @a ctx->p.sigByteLen bytes allocated.
+  * @return	0 if successful, -1 otherwise
+  */
+int sign_with_ctx(const SignCtx* ctx, const unsigned char* message, size_t messageByteLen, unsigned char* sig);
+
+/**
+  * Function to generate a deterministic (or hedged) signature, using a signing context.
+  * The randomness of the rounds is not drawn from the randomness pool, but derived from the secret key,
+  * a hash of the message, the optional input @a rnd and a counter of the signing attempts.
+  * The same key, message and @a rnd always give the same signature, whatever the number of threads.
+  * With fresh random bytes in @a rnd (hedged signing), the signatures are randomized, but their security does not rely on these bytes alone.
+  * @param	ctx		A pointer to a context set up by sign_ctx_init().
+  * @param	message		A pointer to the message to be signed.
+  * @param	messageByteLen	The length of the message, in bytes.
+  * @param	rnd		A pointer to the additional input, or NULL for a deterministic signature.
+  * @param	rndByteLen	The length of the additional input, in bytes (0 if @a rnd is NULL).
+  * @param	sig		A pointer to a buffer where to store the signature.
+  * @pre	At @a sig, there are at least @a ctx->p.sigByteLen bytes allocated.
+  * @return	0 if successful, -1 otherwise
+  */
+int sign_deterministic_with_ctx(const SignCtx* ctx, const unsigned char* message, size_t messageByteLen, const unsigned char* rnd, size_t rndByteLen, unsigned char* sig);
+
+/**
+  * Function to query the size of the workspace of sign_with_ctx_ws().
+  * @param	p	A pointer to a parameter set.
+  * @return	The size of the workspace, in bytes.
+  */
+size_t sign_workspace_size(const Params* p);
+
+/**
+  * Function to generate a signature, using a signing context and a workspace supplied by the caller.
+  * The signature is generated entirely inside the workspace, without allocating any memory and on the calling thread only
+  * (the number of threads of the context is ignored). The workspace holds the data of all rounds, one array per kind of data,
+  * and it is overwritten with zeros before the function returns. It can be reused for any number of signatures, but not by
+  * several threads at the same time.
+  * @param	ctx		A pointer to a context set up by sign_ctx_init().
+  * @param	message		A pointer to the message to be signed.
+  * @param	messageByteLen	The length of the message, in bytes.
+  * @param	sig		A pointer to a buffer where to store the signature.
+  * @param	workspace	A pointer to the workspace, aligned to 64 bytes (a cache line).
+  * @pre	If NIST_API is not defined, rand_init() must have been called already.
+  * @pre	At @a sig, there are at least @a ctx->p.sigByteLen bytes allocated.
+  * @pre	At @a workspace, there are at least sign_workspace_size(&ctx->p) bytes allocated.
+  * @return	0 if successful, -1 otherwise (in particular if @a workspace is not aligned)
+  */
+int sign_with_ctx_ws(const SignCtx* ctx, const unsigned char* message, size_t messageByteLen, unsigned char* sig, void* workspace);
+
+/**
+  * Function to enable parallel signing with a signing context.
+  * The commitments of the rounds are distributed over @a numThreads threads, which are started for every signature.
+  * The randomness is still drawn in the same order, hence the signatures are the same as with one thread (the default).
+  * @param	ctx		A pointer to a signing context.
+  * @param	numThreads	The number of threads, including the calling thread.
+  * @return	0 if successful, -1 otherwise (if @a numThreads is zero)
+  */
+int sign_ctx_set_threads(SignCtx* ctx, size_t numThreads);
+
+/**
+  * Function to release a signing context. All secret data is overwritten.
+  * @param	ctx	A pointer to the context.
+  */
+void sign_ctx_free(SignCtx* ctx);
+
+/**
+  * Function to allocate the memory of a presignature.
+  * @param	p	A pointer to a parameter set.
+  * @param	presig	A pointer to the presignature to be initialized.
+  * @post	@a presig must be released with presig_free(), also if the initialization failed.
+  * @return	0 if successful, -1 otherwise
+  */
+int presig_init(const Params* p, Presig* presig);
+
+/**
+  * Function to generate a presignature (offline phase of the signature generation).
+  * A used presignature can be generated again.
+  * @param	ctx	A pointer to a signing context.
+  * @param	presig	A pointer to a presignature, initialized with the same parameter set as @a ctx.
+  * @pre	If NIST_API is not defined, rand_init() must have been called already.
+  * @return	0 if successful, -1 otherwise
+  */
+int presig_generate(const SignCtx* ctx, Presig* presig);
+
+/**
+  * Function to generate a signature from a presignature (online phase of the signature generation).
+  * Only the message is hashed and the responses are packed. The presignature is used up, also if the function fails.
+  * In the rare case that the signature exceeds the signature size, a fresh signature is generated with sign_with_ctx().
+  * @param	ctx		A pointer to the signing context used to generate @a presig.
+  * @param	presig		A pointer to a presignature.
+  * @param	message		A pointer to the message to be signed.
+  * @param	messageByteLen	The length of the message, in bytes.
+  * @param	sig		A pointer to a buffer where to store the signature.
+  * @pre	At @a sig, there are at least @a ctx->p.sigByteLen bytes allocated.
+  * @return	0 if successful, -1 otherwise (in particular if @a presig has been used already)
+  */
+int sign_with_presig(const SignCtx* ctx, Presig* presig, const unsigned char* message, size_t messageByteLen, unsigned char* sig);
+
+/**
+  * Function to release a presignature. All its data is overwritten.
+  * @param	presig	A pointer to the presignature.
+  */
+void presig_free(Presig* presig);
+
+/**
+  * Function to set up a pool of presignatures and start its worker threads.
+  * The pool is filled in the background, this function does not wait for it.
+  * @param	ctx		A pointer to a signing context. It must not be released before the pool.
+  * @param	lowWatermark	The workers start refilling the pool as soon as at most @a lowWatermark presignatures are ready.
+  * @param	highWatermark	The number of presignatures in the pool, i.e. the workers refill the pool up to @a highWatermark presignatures.
+  * @param	numWorkers	The number of worker threads.
+  * @param	pool		A pointer to the pool to be initialized.
+  * @pre	If NIST_API is not defined, rand_init() must have been called already.
+  * @pre	@a lowWatermark < @a highWatermark and @a numWorkers > 0.
+  * @post	@a pool must be released with presig_pool_free(), also if the initialization failed.
+  * @return	0 if successful, -1 otherwise
+  */
+int presig_pool_init(const SignCtx* ctx, size_t lowWatermark, size_t highWatermark, size_t numWorkers, PresigPool* pool);
+
+/**
+  * Function to generate a signature, using a presignature from a pool.
+  * If no presignature is ready, the signature is generated with sign_with_ctx().
+  * This function can be called by several threads at the same time.
+  * @param	pool		A pointer to a pool set up by presig_pool_init().
+  * @param	message		A pointer to the message to be signed.
+  * @param	messageByteLen	The length of the message, in bytes.
+  * @param	sig		A pointer to a buffer where to store the signature.
+  * @pre	At @a sig, there are at least @a pool->ctx->p.sigByteLen bytes allocated.
+  * @return	0 if successful, -1 otherwise
+  */
+int sign_with_pool(PresigPool* pool, const unsigned char* message, size_t messageByteLen, unsigned char* sig);
+
+/**
+  * Function to read the counters of a pool.
+  * @param	pool	A pointer to a pool.
+  * @param	hits	A pointer to where to store the number of signatures generated from a presignature of the pool.
+  * @param	misses	A pointer to where to store the number of signatures generated from scratch because the pool was drained.
+  * @param	ready	A pointer to where to store the number of presignatures that are ready right now.
+  */
+void presig_pool_stats(PresigPool* pool, size_t* hits, size_t* misses, size_t* ready);
+
+/**
+  * Function to stop the worker threads of a pool and release it. All presignatures are overwritten.
+  * @param	pool	A pointer to the pool.
+  */
+void presig_pool_free(PresigPool* pool);
+
+/**
+  * Function to start a signature on a message that is given in several parts, e.g. read from a file.
+  * The commitment phase is completed before any part of the message is needed, hence the memory does not depend on the message length.
+  * All memory is allocated here, sign_update() and sign_final() allocate nothing.
+  * @param	ctx	A pointer to a signing context. It must not be released before @a stream.
+  * @param	stream	A pointer to the signature generation to be initialized.
+  * @pre	If NIST_API is not defined, rand_init() must have been called already.
+  * @post	@a stream must be released with sign_stream_free(), also if the initialization failed.
+  * @return	0 if successful, -1 otherwise
+  */
+int sign_init(const SignCtx* ctx, SignStream* stream);
+
+/**
+  * Function to feed the next part of the message into a signature generation.
+  * @param	stream		A pointer to a signature generation set up by sign_init().
+  * @param	part		A pointer to the next part of the message.
+  * @param	partByteLen	The length of the part, in bytes.
+  * @return	0 if successful, -1 otherwise (in particular if sign_final() has been called already)
+  */
+int sign_update(SignStream* stream, const unsigned char* part, size_t partByteLen);
+
+/**
+  * Function to complete a signature generation on the message fed by sign_update().
+  * The signature is the same as the one of sign_with_ctx() on the concatenated parts with the same randomness.
+  * In the rare case that the signature exceeds the signature size, @a *success is set to false,
+  * then the message must be signed again from sign_init() on.
+  * @param	stream	A pointer to a signature generation set up by sign_init().
+  * @param	sig	A pointer to a buffer where to store the signature.
+  * @param	success	A pointer to a bool where to store whether @a sig holds a valid signature.
+  * @pre	At @a sig, there are at least @a stream->ctx->p.sigByteLen bytes allocated.
+  * @return	0 if successful, -1 otherwise (in particular if sign_final() has been called already)
+  */
+int sign_final(SignStream* stream, unsigned char* sig, bool* success);
+
+/**
+  * Function to release a signature generation. The secret data of its commitments is overwritten.
+  * @param	stream	A pointer to the signature generation.
+  */
+void sign_stream_free(SignStream* stream);
+
 /**
   * Function to verify a signature.
   * @param	p		A pointer to a parameter set.
@@ -193,5 +652,119 @@ int sign(const Params* p, const unsigned char* sk, const unsigned char* message,
   */
 int verify(const Params* p, const unsigned char* pk, const unsigned char* message, size_t messageByteLen, const unsigned char* sig, bool* accept);
 
+/**
+  * Function to set up a verification context for a public key.
+  * @param	p	A pointer to a parameter set.
+  * @param	pk	A pointer to the public key.
+  * @param	ctx	A pointer to the context to be initialized.
+  * @post	@a ctx must be released with verify_ctx_free(), also if the initialization failed.
+  * @return	0 if successful, -1 otherwise
+  */
+int verify_ctx_init(const Params* p, const unsigned char* pk, VerifyCtx* ctx);
+
+/**
+  * Function to verify a signature, using a verification context.
+  * The context is not modified, thus it can be used by several threads at the same time.
+  * @param	ctx		A pointer to a context set up by verify_ctx_init().
+  * @param	message		A pointer to the message to be signed.
+  * @param	messageByteLen	The length of the message, in bytes.
+  * @param	sig		A pointer to the signature.
+  * @param	accept		A pointer to a bool where to store the result of the verification.
+  *				For a valid signature, the final state of @a *accept will be true,
+  *				false otherwise.
+  * @return	0 if successful, -1 otherwise
+  */
+int verify_with_ctx(const VerifyCtx* ctx, const unsigned char* message, size_t messageByteLen, const unsigned char* sig, bool* accept);
+
+/**
+  * Function to query the size of the workspace of verify_with_ctx_ws().
+  * @param	p	A pointer to a parameter set.
+  * @return	The size of the workspace, in bytes.
+  */
+size_t verify_workspace_size(const Params* p);
+
+/**
+  * Function to verify a signature, using a verification context and a workspace supplied by the caller.
+  * The signature is verified entirely inside the workspace, without allocating any memory and on the calling thread only
+  * (the number of threads of the context is ignored). The workspace can be reused for any number of verifications,
+  * but not by several threads at the same time.
+  * @param	ctx		A pointer to a context set up by verify_ctx_init().
+  * @param	message		A pointer to the message to be signed.
+  * @param	messageByteLen	The length of the message, in bytes.
+  * @param	sig		A pointer to the signature.
+  * @param	accept		A pointer to a bool where to store the result of the verification.
+  *				For a valid signature, the final state of @a *accept will be true,
+  *				false otherwise.
+  * @param	workspace	A pointer to the workspace, aligned to 64 bytes (a cache line).
+  * @pre	At @a workspace, there are at least verify_workspace_size(&ctx->p) bytes allocated.
+  * @return	0 if successful, -1 otherwise (in particular if @a workspace is not aligned)
+  */
+int verify_with_ctx_ws(const VerifyCtx* ctx, const unsigned char* message, size_t messageByteLen, const unsigned char* sig, bool* accept, void* workspace);
+
+/**
+  * Function to enable parallel verification with a verification context.
+  * The rounds are distributed over @a numThreads threads, which are started for every verification.
+  * @param	ctx		A pointer to a verification context.
+  * @param	numThreads	The number of threads, including the calling thread.
+  * @return	0 if successful, -1 otherwise (if @a numThreads is zero)
+  */
+int verify_ctx_set_threads(VerifyCtx* ctx, size_t numThreads);
+
+/**
+  * Function to release a verification context.
+  * @param	ctx	A pointer to the context.
+  */
+void verify_ctx_free(VerifyCtx* ctx);
+
+/**
+  * Function to start the verification of a signature on a message that is given in several parts, e.g. read from a file.
+  * The responses of the rounds are verified right away, they do not depend on the message.
+  * @param	ctx	A pointer to a verification context. It must not be released before @a stream.
+  * @param	sig	A pointer to the signature. It is not accessed after this function returns.
+  * @param	stream	A pointer to the verification to be initialized.
+  * @post	@a stream must be released with verify_stream_free(), also if the initialization failed.
+  * @return	0 if successful, -1 otherwise
+  */
+int verify_init(const VerifyCtx* ctx, const unsigned char* sig, VerifyStream* stream);
+
+/**
+  * Function to feed the next part of the message into a verification.
+  * @param	stream		A pointer to a verification set up by verify_init().
+  * @param	part		A pointer to the next part of the message.
+  * @param	partByteLen	The length of the part, in bytes.
+  * @return	0 if successful, -1 otherwise (in particular if verify_final() has been called already)
+  */
+int verify_update(VerifyStream* stream, const unsigned char* part, size_t partByteLen);
+
+/**
+  * Function to complete a verification of a signature on the message fed by verify_update().
+  * @param	stream	A pointer to a verification set up by verify_init().
+  * @param	accept	A pointer to a bool where to store the result of the verification.
+  *			For a valid signature, the final state of @a *accept will be true,
+  *			false otherwise.
+  * @return	0 if successful, -1 otherwise (in particular if verify_final() has been called already)
+  */
+int verify_final(VerifyStream* stream, bool* accept);
+
+/**
+  * Function to release a verification.
+  * @param	stream	A pointer to the verification.
+  */
+void verify_stream_free(VerifyStream* stream);
+
+#ifdef PERMUTATIONS_USE_BENES
+/**
+  * Function to test the Beneš networks: applies @a count permutations with random seeds to random vectors,
+  * as a Beneš network and by index, and counts the permutations for which the results differ.
+  * Only available if PERMUTATIONS_USE_BENES is defined, e.g. in the build of "make benes".
+  * @param	p		A pointer to a parameter set.
+  * @param	count		The number of permutations.
+  * @param	mismatches	A pointer to a size_t where to store the number of permutations with differing results.
+  * @pre	If NIST_API is not defined, rand_init() must have been called already.
+  * @return	0 if successful, -1 otherwise
+  */
+int perm_compare_benes(const Params* p, size_t count, size_t* mismatches);
+#endif // PERMUTATIONS_USE_BENES
+
 #endif // SIG_H
 